@@ -138,6 +138,8 @@ module VideoCore #(parameter flip = 0)
             .i_status_request(w_status_request),
             .o_status_data(w_status_data),
 
+            .o_interrupt(w_status_interrupt),
+
             .i_system_rendering_mode(w_system_rendering_mode),
 
             .i_video_descriptor_ready(w_mcu_playback_available),
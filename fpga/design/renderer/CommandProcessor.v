@@ -177,6 +177,27 @@ module CommandProcessor (
     reg[9:0]    r_cmd_texture_stripe;
     reg[19:0]   r_cmd_texture_base;
 
+    // opcodes
+    localparam OP_RECT                      = 2'h0;     // full rectangle command follows
+    localparam OP_RECT_SAME                 = 2'h1;     // relative rectangle, color as previous
+    localparam OP_GLYPH                     = 2'h2;     // relative rectangle & texture base
+    localparam OP_GLYPHS                    = 2'h3;     // glyph count - 1, relative glyphs follow
+
+    // byte layout of the compact commands
+    //   0: opcode
+    //   1: glyph count - 1 (OP_GLYPHS only)
+    //   2: x1 delta (signed)
+    //   3: y1 delta (signed)
+    //   4: width - 1
+    //   5: height - 1
+    //   6-8: texture base (OP_GLYPH & OP_GLYPHS only)
+    // OP_RECT is followed by the full rectangle command (bytes 1-12)
+
+    reg[1:0]    r_cmd_opcode = OP_RECT;
+
+    // glyphs remaining in the glyph batch
+    reg[7:0]    r_glyphs_left = 0;
+
     // byte counter
     reg[3:0]    r_cmd_byte;
 
@@ -184,91 +205,142 @@ module CommandProcessor (
 
         case (r_fetch_state)
 
-            STATE_FETCH_START: 
-                r_cmd_byte <= 0;
+            STATE_FETCH_START: begin
+                if(r_glyphs_left != 0) begin
+                    // next glyph of the batch
+                    r_cmd_byte <= 2;
+                    r_glyphs_left <= r_glyphs_left - 1;
+                end else begin
+                    r_cmd_byte <= 0;
+                end
+            end
 
             STATE_FETCH_WAIT: begin
-                if(i_queue_data_valid && !w_last_byte)
-                    r_cmd_byte <= r_cmd_byte + 1;
+                if(i_queue_data_valid && !w_last_byte) begin
+                    if(r_cmd_byte == 0 && (i_queue_data[1:0] == OP_RECT_SAME || i_queue_data[1:0] == OP_GLYPH))
+                        r_cmd_byte <= 2;
+                    else
+                        r_cmd_byte <= r_cmd_byte + 1;
+                end
+                if(i_queue_data_valid && r_cmd_byte == 1 && r_cmd_opcode == OP_GLYPHS)
+                    r_glyphs_left <= i_queue_data;
             end
+
+            STATE_FETCH_DONE:
+                r_glyphs_left <= 0;
             
         endcase
 
     end
 
     // SIGNAL: last byte of the command
-    wire        w_last_byte = r_cmd_textured
+    wire        w_last_byte = (r_cmd_byte == 0) ? 1'b0 :
+        (r_cmd_opcode == OP_RECT_SAME) ? (r_cmd_byte == 5) :
+        (r_cmd_opcode != OP_RECT) ? (r_cmd_byte == 8) :
+        r_cmd_textured
         ? (r_cmd_texture_packed
-            ? (r_cmd_byte == 11) 
-            : (r_cmd_byte == 9))
-        : (r_cmd_byte == 7);
+            ? (r_cmd_byte == 12) 
+            : (r_cmd_byte == 10))
+        : (r_cmd_byte == 8);
 
     // decode command
     always @(posedge i_master_clk) begin
         if((r_fetch_state == STATE_FETCH_WAIT) && i_queue_data_valid) begin
-            case (r_cmd_byte)
-
-                4'h0:
-                    r_cmd_y1[7:0] <= i_queue_data;
+            if(r_cmd_byte == 0) begin
+                r_cmd_opcode <= i_queue_data[1:0];
+                if(i_queue_data[1:0] == OP_GLYPH || i_queue_data[1:0] == OP_GLYPHS)
+                    r_cmd_textured <= 1;
+            end else if(r_cmd_opcode == OP_RECT) begin
+                case (r_cmd_byte)
+
+                    4'h1:
+                        r_cmd_y1[7:0] <= i_queue_data;
+
+                    4'h2:
+                        r_cmd_x1[7:0] <= i_queue_data;
+
+                    4'h3:
+                        r_cmd_y2[7:0] <= i_queue_data;
+
+                    4'h4:
+                        r_cmd_x2[7:0] <= i_queue_data;
+
+                    4'h5: begin
+                        r_cmd_y1[9:8] <= i_queue_data[1:0];
+                        r_cmd_x1[9:8] <= i_queue_data[3:2];
+                        r_cmd_y2[9:8] <= i_queue_data[5:4];
+                        r_cmd_x2[9:8] <= i_queue_data[7:6];
+                    end
 
-                4'h1:
-                    r_cmd_x1[7:0] <= i_queue_data;
+                    4'h6: begin
+                        r_cmd_textured <= i_queue_data[0];
+                        r_cmd_texture_copy <= i_queue_data[0] && i_queue_data[1];
+                        r_cmd_texture_packed <= i_queue_data[0] && !i_queue_data[2];
+                        r_cmd_texture_stripe[9:8] <= i_queue_data[7:6];
+                    end
 
-                4'h2:
-                    r_cmd_y2[7:0] <= i_queue_data;
+                    4'h7: begin
+                        if(r_cmd_textured) begin
+                            r_cmd_texture_stripe[7:0] <= i_queue_data;
+                        end else begin
+                            r_cmd_color_g <= i_queue_data[7:4];
+                            r_cmd_color_r <= i_queue_data[3:0];
+                        end
+                    end
 
-                4'h3:
-                    r_cmd_x2[7:0] <= i_queue_data;
+                    4'h8: begin
+                        if(r_cmd_textured) begin
+                            r_cmd_texture_base[7:0] <= i_queue_data;
+                        end else begin
+                            r_cmd_color_a <= i_queue_data[7:4];
+                            r_cmd_color_b <= i_queue_data[3:0];
+                        end
+                    end
+                    
+                    4'h9:
+                        r_cmd_texture_base[15:8] <= i_queue_data;
 
-                4'h4: begin
-                    r_cmd_y1[9:8] <= i_queue_data[1:0];
-                    r_cmd_x1[9:8] <= i_queue_data[3:2];
-                    r_cmd_y2[9:8] <= i_queue_data[5:4];
-                    r_cmd_x2[9:8] <= i_queue_data[7:6];
-                end
+                    4'ha:
+                        r_cmd_texture_base[19:16] <= i_queue_data[3:0]; 
 
-                4'h5: begin
-                    r_cmd_textured <= i_queue_data[0];
-                    r_cmd_texture_copy <= i_queue_data[0] && i_queue_data[1];
-                    r_cmd_texture_packed <= i_queue_data[0] && !i_queue_data[2];
-                    r_cmd_texture_stripe[9:8] <= i_queue_data[7:6];
-                end
-
-                4'h6: begin
-                    if(r_cmd_textured) begin
-                        r_cmd_texture_stripe[7:0] <= i_queue_data;
-                    end else begin
+                    4'hb: begin
                         r_cmd_color_g <= i_queue_data[7:4];
                         r_cmd_color_r <= i_queue_data[3:0];
                     end
-                end
 
-                4'h7: begin
-                    if(r_cmd_textured) begin
-                        r_cmd_texture_base[7:0] <= i_queue_data;
-                    end else begin
-                        r_cmd_color_a <= i_queue_data[7:4];
+                    4'hc: begin
+                        r_cmd_color_a <= 0;
                         r_cmd_color_b <= i_queue_data[3:0];
                     end
-                end
-                
-                4'h8:
-                    r_cmd_texture_base[15:8] <= i_queue_data;
 
-                4'h9:
-                    r_cmd_texture_base[19:16] <= i_queue_data[3:0]; 
+                endcase
+            end else begin
+                // compact commands (relative to the previous command)
+                case (r_cmd_byte)
 
-                4'ha: begin
-                    r_cmd_color_g <= i_queue_data[7:4];
-                    r_cmd_color_r <= i_queue_data[3:0];
-                end
+                    4'h2:
+                        r_cmd_x1 <= r_cmd_x1 + {{2{i_queue_data[7]}}, i_queue_data};
 
-                4'hb: begin
-                    r_cmd_color_a <= 0;
-                    r_cmd_color_b <= i_queue_data[3:0];
-                end
+                    4'h3:
+                        r_cmd_y1 <= r_cmd_y1 + {{2{i_queue_data[7]}}, i_queue_data};
+
+                    4'h4:
+                        r_cmd_x2 <= r_cmd_x1 + {2'b00, i_queue_data};
 
-            endcase
+                    4'h5:
+                        r_cmd_y2 <= r_cmd_y1 + {2'b00, i_queue_data};
+
+                    4'h6:
+                        r_cmd_texture_base[7:0] <= i_queue_data;
+
+                    4'h7:
+                        r_cmd_texture_base[15:8] <= i_queue_data;
+
+                    4'h8:
+                        r_cmd_texture_base[19:16] <= i_queue_data[3:0];
+
+                endcase
+            end
         end
     end
 
@@ -11,6 +11,9 @@ module StatusController (
         i_status_request,
         o_status_data,
 
+        // MCU interface (master clock domain)
+        o_interrupt,
+
         // BUFFER CONTROLLER interface (master clock domain)
         i_buffer_locked,
 
@@ -29,6 +32,8 @@ module StatusController (
     input       i_status_request;
     output[7:0] o_status_data;
 
+    output      o_interrupt;
+
     input       i_buffer_locked;
 
     input[1:0]  i_system_rendering_mode;
@@ -73,4 +78,29 @@ module StatusController (
 
     assign o_status_data = r_status;
 
+    // ***********************************************
+    // **                                           **
+    // **   READY LINE                              **
+    // **                                           **
+    // ***********************************************
+
+    // raised when a queue buffer gets free or on VSYNC, cleared by the status request
+    reg r_buffer_locked = 0;
+
+    always @(posedge i_master_clk)
+        r_buffer_locked <= i_buffer_locked;
+
+    wire w_buffer_freed = r_buffer_locked && !i_buffer_locked;
+
+    reg r_interrupt = 0;
+
+    always @(posedge i_master_clk) begin
+        if(w_buffer_freed || w_vsync)
+            r_interrupt <= 1'b1;
+        else if(i_status_request)
+            r_interrupt <= 1'b0;
+    end
+
+    assign o_interrupt = r_interrupt;
+
 endmodule
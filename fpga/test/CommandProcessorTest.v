@@ -0,0 +1,199 @@
+`timescale 1ns / 1ps
+
+// Feeds the command queues encoded by the renderer (test/test-commands.c) into
+// the command processor and compares every decoded command with the encoded one.
+//   +queue=<file>      queue bytes, one per line, 100 ends the queue
+//   +commands=<file>   expected commands, one per line (see write_command())
+
+module CommandProcessorTest;
+
+    // 50 MHz master clock
+    reg         r_clk = 0;
+
+    always
+        #10 r_clk = !r_clk;
+
+    // ***********************************************
+    // **                                           **
+    // **   TEST VECTORS                            **
+    // **                                           **
+    // ***********************************************
+
+    localparam QUEUE_BYTES          = 1 << 20;
+    localparam COMMANDS             = 1 << 18;
+
+    reg[8:0]    r_queue[0:QUEUE_BYTES - 1];
+    reg[107:0]  r_commands[0:COMMANDS - 1];
+
+    reg[1023:0] r_queue_file;
+    reg[1023:0] r_commands_file;
+
+    // ***********************************************
+    // **                                           **
+    // **   COMMAND PROCESSOR                       **
+    // **                                           **
+    // ***********************************************
+
+    reg         r_process_start = 0;
+    wire        w_process_done;
+
+    wire        w_queue_request;
+    reg[7:0]    r_queue_data = 0;
+    reg         r_queue_data_valid = 0;
+    reg         r_queue_eof = 0;
+
+    wire        w_cmd_valid;
+    reg         r_cmd_finished = 0;
+    wire[9:0]   w_cmd_x1;
+    wire[9:0]   w_cmd_y1;
+    wire[9:0]   w_cmd_x2;
+    wire[9:0]   w_cmd_y2;
+    wire[3:0]   w_cmd_color_r;
+    wire[3:0]   w_cmd_color_g;
+    wire[3:0]   w_cmd_color_b;
+    wire[3:0]   w_cmd_color_a;
+    wire        w_cmd_textured;
+    wire        w_cmd_texture_packed;
+    wire        w_cmd_texture_copy;
+    wire[19:0]  w_cmd_texture_base;
+    wire[9:0]   w_cmd_texture_stripe;
+    wire        w_rendering;
+
+    CommandProcessor processor (
+        .i_master_clk(r_clk),
+        .i_process_start(r_process_start),
+        .o_process_done(w_process_done),
+        .o_queue_request(w_queue_request),
+        .i_queue_data(r_queue_data),
+        .i_queue_data_valid(r_queue_data_valid),
+        .i_queue_eof(r_queue_eof),
+        .o_cmd_valid(w_cmd_valid),
+        .i_cmd_finished(r_cmd_finished),
+        .o_cmd_x1(w_cmd_x1),
+        .o_cmd_y1(w_cmd_y1),
+        .o_cmd_x2(w_cmd_x2),
+        .o_cmd_y2(w_cmd_y2),
+        .o_cmd_color_r(w_cmd_color_r),
+        .o_cmd_color_g(w_cmd_color_g),
+        .o_cmd_color_b(w_cmd_color_b),
+        .o_cmd_color_a(w_cmd_color_a),
+        .o_cmd_textured(w_cmd_textured),
+        .o_cmd_texture_packed(w_cmd_texture_packed),
+        .o_cmd_texture_copy(w_cmd_texture_copy),
+        .o_cmd_texture_base(w_cmd_texture_base),
+        .o_cmd_texture_stripe(w_cmd_texture_stripe),
+        .dbg_rendering(w_rendering)
+    );
+
+    // ***********************************************
+    // **                                           **
+    // **   QUEUE                                   **
+    // **                                           **
+    // ***********************************************
+
+    // one byte (or the end of the queue) for every request
+    integer     r_queue_position = 0;
+
+    always @(posedge r_clk) begin
+        r_queue_data_valid <= w_queue_request;
+        if(w_queue_request) begin
+            r_queue_data <= r_queue[r_queue_position][7:0];
+            r_queue_eof <= r_queue[r_queue_position][8];
+            r_queue_position <= r_queue_position + 1;
+        end
+    end
+
+    // ***********************************************
+    // **                                           **
+    // **   RENDERER                                **
+    // **                                           **
+    // ***********************************************
+
+    integer     r_command = 0;
+    integer     r_errors = 0;
+    reg[107:0]  r_expected;
+
+    // SIGNAL: decoded command matches (texture & color registers compared when used)
+    wire        w_textured = r_expected[40];
+    wire        w_packed = r_expected[36];
+    wire        w_match =
+        w_cmd_x1 === r_expected[105:96]
+        && w_cmd_y1 === r_expected[93:84]
+        && w_cmd_x2 === r_expected[81:72]
+        && w_cmd_y2 === r_expected[69:60]
+        && w_cmd_textured === w_textured
+        && (w_textured && !w_packed
+            || (w_cmd_color_r === r_expected[59:56]
+                && w_cmd_color_g === r_expected[55:52]
+                && w_cmd_color_b === r_expected[51:48]
+                && w_cmd_color_a === r_expected[47:44]))
+        && (!w_textured
+            || (w_cmd_texture_packed === w_packed
+                && w_cmd_texture_copy === r_expected[32]
+                && w_cmd_texture_stripe === r_expected[29:20]
+                && w_cmd_texture_base === r_expected[19:0]));
+
+    always @(*)
+        r_expected = r_commands[r_command];
+
+    // command rendered in the next cycle
+    always @(posedge r_clk) begin
+        r_cmd_finished <= w_cmd_valid;
+        if(w_cmd_valid) begin
+            if(!w_match) begin
+                if(r_errors < 10)
+                    $display("Command %0d: decoded (%0d,%0d)-(%0d,%0d), expected %h", r_command,
+                        w_cmd_x1, w_cmd_y1, w_cmd_x2, w_cmd_y2, r_expected);
+                r_errors <= r_errors + 1;
+            end
+            r_command <= r_command + 1;
+        end
+    end
+
+    // ***********************************************
+    // **                                           **
+    // **   TEST                                    **
+    // **                                           **
+    // ***********************************************
+
+    integer     r_queues = 0;
+    integer     r_cycles;
+
+    initial begin
+        if(!$value$plusargs("queue=%s", r_queue_file) || !$value$plusargs("commands=%s", r_commands_file)) begin
+            $display("Usage: +queue=<file> +commands=<file>");
+            $finish;
+        end
+        $readmemh(r_queue_file, r_queue);
+        $readmemh(r_commands_file, r_commands);
+
+        // queues until the end of the vectors
+        while(r_queue[r_queue_position] !== 9'bx) begin
+            @(posedge r_clk);
+            r_process_start <= 1;
+            @(posedge r_clk);
+            r_process_start <= 0;
+            r_cycles = 0;
+            while(!w_process_done && r_cycles < 1000000) begin
+                @(posedge r_clk);
+                r_cycles = r_cycles + 1;
+            end
+            if(!w_process_done) begin
+                $display("Queue %0d: not processed", r_queues);
+                $finish;
+            end
+            r_queues = r_queues + 1;
+        end
+
+        if(r_commands[r_command] !== 108'bx) begin
+            $display("Queue end reached at command %0d, more commands expected", r_command);
+            r_errors = r_errors + 1;
+        end
+        if(r_errors == 0)
+            $display("PASSED: %0d commands in %0d queues", r_command, r_queues);
+        else
+            $display("FAILED: %0d of %0d commands differ", r_errors, r_command);
+        $finish;
+    end
+
+endmodule
@@ -44,6 +44,29 @@ typedef struct tRendererTexture {
     bool packed_alpha;
 } tRendererTexture;
 
+// maximal number of tiles in the scene
+#ifndef RENDERER_MAX_TILES
+#define RENDERER_MAX_TILES                        512
+#endif
+
+// number of 32-bit words of a tile bitmap
+#define RENDERER_BITMAP_WORDS(count)              (((count) + 31) >> 5)
+
+typedef struct tRendererRect {
+    tRendererPosition left;
+    tRendererPosition top;
+    tRendererPosition right;
+    tRendererPosition bottom;
+} tRendererRect;
+
+// packed tile color, mode & texture (compared to detect tile content changes)
+typedef struct tRendererAppearance {
+    uint32_t color;
+    uint32_t texture;
+} tRendererAppearance;
+
+// tile properties rarely touched by the rendering
+// (position, visibility & appearance live in the hot arrays below)
 typedef struct tRendererTile {
     // tree
     tRendererTileHandle parent_tile;
@@ -52,30 +75,21 @@ typedef struct tRendererTile {
     uint16_t children_count;
     uint8_t gauge_marks_count;
 
-    bool changed;
-
-
-    // visibility
-    bool tile_visible;
-    bool parent_visible;
+    // rendering mode
+    uint8_t rendering_mode;     // eRendererTileMode
 
-    // position (for rendering)
-    tRendererPosition position_left;
-    tRendererPosition position_right;
-    tRendererPosition position_top;
-    tRendererPosition position_bottom;
+    // size
     tRendererPosition position_width;
     tRendererPosition position_height;
 
-    // rendering mode
-    eRendererTileMode rendering_mode;
-
     // color
     tRendererColorHandle color_handle;
     tRendererColor color;
 
     // texture
     tRendererTexture texture;
+    // glyph shown by a text character tile (RENDERER_NULL_HANDLE if none)
+    uint16_t glyph;
 
 } tRendererTile;
 
@@ -95,6 +109,15 @@ typedef struct tRendererFont {
     uint16_t space_width;
 } tRendererFont;
 
+// glyph lookup of a font (built by the scene decoder)
+#define RENDERER_GLYPH_ASCII_FIRST                0x20
+#define RENDERER_GLYPH_ASCII_COUNT                0x5f
+
+typedef struct tRendererFontIndex {
+    // glyph of each printable ASCII character (RENDERER_NULL_HANDLE if none)
+    uint16_t ascii[RENDERER_GLYPH_ASCII_COUNT];
+} tRendererFontIndex;
+
 typedef enum eRendererHAlignment {
     TEXT_LEFT, TEXT_CENTER, TEXT_RIGHT
 } eRendererHAlignment;
@@ -111,19 +134,31 @@ typedef struct tRendererText {
     tRendererPosition position_y;
     eRendererHAlignment alignment_h;
     eRendererVAlignment alignment_v;
-    uint16_t *text;
+    const uint16_t *text;
 } tRendererText;
 
 typedef struct tRendererVideoDescriptor {
     uint16_t frame_count;
-    const uint32_t *frame_offsets;
-    const uint8_t *data;
+    const uint32_t *frame_offsets;  // video memory address of each frame (ascending)
+    uint32_t base;                  // frame data in the scene image
     uint32_t length;
 } tRendererVideoDescriptor;
 
+// bundle compression
+//  - RLE: control byte c < 0x80 is followed by c + 1 literal bytes,
+//    control byte c >= 0x80 repeats the following byte c - 0x7e times
+#define RENDERER_COMPRESSION_NONE                 0
+#define RENDERER_COMPRESSION_RLE                  1
+
+// bundles are hashed per page (CRC-32 of the uncompressed page bytes)
+#define RENDERER_BUNDLE_PAGE_SIZE                 4096
+
 typedef struct tRendererScreenGraphics {
-    uint32_t length;
+    uint32_t length;                // uploaded (decompressed) bytes
     uint32_t base;
+    uint32_t stored_length;         // bytes in the scene image
+    uint16_t compression;           // RENDERER_COMPRESSION_*
+    uint16_t first_page;            // index to renderer_graphics_pages (RENDERER_NULL_HANDLE: not hashed)
 } tRendererScreenGraphics;
 
 typedef struct tRendererScreen {
@@ -131,33 +166,93 @@ typedef struct tRendererScreen {
     tRendererTileHandle root_tile;
 } tRendererScreen;
 
-extern uint16_t *renderer_colors;
+extern const uint16_t *renderer_colors;
 extern uint16_t renderer_colors_simple_count;
 
-extern tRendererFontGlyph *renderer_font_glyphs;
+extern const tRendererFontGlyph *renderer_font_glyphs;
 extern uint16_t renderer_font_glyphs_count;
 
-extern tRendererFont * renderer_fonts;
+extern const tRendererFont * renderer_fonts;
 extern uint16_t renderer_fonts_count;
 
+extern const tRendererFontIndex *renderer_font_index;
+// glyph handles sorted by the code point within the glyph range of every font
+extern const uint16_t *renderer_glyph_order;
+
 extern tRendererText *renderer_texts;
 extern uint16_t renderer_texts_count;
 
 extern tRendererTile *renderer_tiles;
 extern uint16_t renderer_tiles_count;
 
-extern tRendererTileHandle *renderer_child_index;
+// hot tile state (structure of arrays indexed by tile handle)
+extern tRendererRect *renderer_tile_rects;
+extern uint32_t *renderer_tile_visible;
+extern uint32_t *renderer_tile_parent_visible;
+extern tRendererAppearance *renderer_tile_appearance;
+
+// tiles changed since last rendered (set by the scene mutators)
+extern uint32_t renderer_tile_dirty[RENDERER_BITMAP_WORDS(RENDERER_MAX_TILES)];
+extern bool renderer_tiles_dirty;
+
+extern const tRendererTileHandle *renderer_child_index;
 extern uint16_t renderer_child_index_count;
 
-extern tRendererScreen *renderer_screens;
+extern const tRendererScreen *renderer_screens;
 extern uint16_t renderer_screen_count;
 
 extern tRendererVideoDescriptor *renderer_videos;
 extern uint16_t renderer_videos_count;
 
-extern tRendererScreenGraphics *renderer_graphics;
+extern const tRendererScreenGraphics *renderer_graphics;
 extern uint16_t renderer_graphics_count;
 
+extern const uint32_t *renderer_graphics_pages;
+extern uint16_t renderer_graphics_pages_count;
+
 extern const char *renderer_script;
 
+static inline bool renderer_bit_get(const uint32_t *bitmap, unsigned index) {
+    return (bitmap[index >> 5] >> (index & 31)) & 1;
+}
+
+static inline void renderer_bit_set(uint32_t *bitmap, unsigned index, bool value) {
+    if (value)
+        bitmap[index >> 5] |= ((uint32_t) 1) << (index & 31);
+    else
+        bitmap[index >> 5] &= ~(((uint32_t) 1) << (index & 31));
+}
+
+static inline void renderer_mark_dirty(tRendererTileHandle tile_handle) {
+    renderer_bit_set(renderer_tile_dirty, tile_handle, true);
+    renderer_tiles_dirty = true;
+}
+
+// tile and all its parents visible
+static inline bool renderer_tile_shown(tRendererTileHandle tile_handle) {
+    return renderer_bit_get(renderer_tile_visible, tile_handle)
+           && renderer_bit_get(renderer_tile_parent_visible, tile_handle);
+}
+
+// everything the video core gets to know about the tile content
+static inline tRendererAppearance renderer_appearance_pack(const tRendererTile *tile) {
+    tRendererAppearance appearance;
+    appearance.color = ((tile->color.red >> 4) << 12)
+                       | ((tile->color.green >> 4) << 8)
+                       | ((tile->color.blue >> 4) << 4)
+                       | (tile->color.alpha >> 4)
+                       | (((uint32_t) tile->rendering_mode) << 16);
+    appearance.texture = 0;
+    if (tile->rendering_mode != COLOR) {
+        appearance.color |= ((uint32_t) (tile->texture.stripe_length & 0x3ff)) << 18;
+        appearance.color |= tile->texture.packed_alpha ? (((uint32_t) 1) << 28) : 0;
+        appearance.texture = tile->texture.base;
+    }
+    return appearance;
+}
+
+static inline bool renderer_appearance_equal(const tRendererAppearance *a, const tRendererAppearance *b) {
+    return a->color == b->color && a->texture == b->texture;
+}
+
 #endif //RENDERER_TEST_RENDERER_DEFINITION_H
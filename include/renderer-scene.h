@@ -17,6 +17,17 @@ void renderer_set_color(tRendererTileHandle tile, tRendererColorHandle color);
 
 void renderer_set_text(tRendererTileHandle tile, const char *text);
 
+// number formatting of renderer_set_number()
+#define RENDERER_NUMBER_DECIMALS(n)               ((n) & 0x07)          // fixed point, digits after '.'
+#define RENDERER_NUMBER_PAD(n)                    (((n) & 0x0f) << 4)   // minimal digits (leading zeros)
+#define RENDERER_NUMBER_PLUS                      0x0100                // '+' for positive numbers
+#define RENDERER_NUMBER_GET_DECIMALS(format)      ((format) & 0x07)
+#define RENDERER_NUMBER_GET_PAD(format)           (((format) >> 4) & 0x0f)
+#define RENDERER_NUMBER_LENGTH                    20
+
+// same as renderer_set_text() with the formatted number (ASCII glyphs only)
+void renderer_set_number(tRendererTileHandle tile, int32_t value, uint16_t format);
+
 void renderer_show_screen(tRendererScreenHandle screen_handle);
 
 typedef void (*rRendererVideoCallback)(const void*);
@@ -10,11 +10,41 @@
 
 void renderer_init();
 
+// the tile tables are being replaced (scene decoding started or fell back to
+// the built-in scene), nothing is rendered until the next renderer_show_screen()
+void renderer_reset();
+
 //bool renderer_handle();
 
 void renderer_update_display(uint8_t* queue_data, uint16_t queue_max_length,
                              uint16_t* queue_lenth);
 
+// frame did not fit into the queue, rest is sent with next queue(s)
+bool renderer_frame_pending();
+
+typedef struct tRendererStatistics {
+    // rendered frames
+    uint32_t frames;
+    // damaged areas reported by changed tiles
+    uint32_t requested_areas;
+    uint32_t requested_pixels;
+    // areas actually redrawn (merged, split & deduplicated)
+    uint32_t rendered_areas;
+    uint32_t rendered_pixels;
+    // commands generated
+    uint32_t commands;
+    // commands the requested areas would generate (RENDERER_DAMAGE_STATISTICS only)
+    uint32_t requested_commands;
+    // commands skipped as hidden under opaque tiles
+    uint32_t occluded_commands;
+    // queues sent (a frame may take several queues)
+    uint32_t queues;
+    // longest queue (bytes)
+    uint16_t queue_peak;
+} tRendererStatistics;
+
+void renderer_get_statistics(tRendererStatistics* statistics);
+
 
 
 #endif //RENDERER_RENDERER_H
@@ -12,8 +12,48 @@
 extern const unsigned renderer_data_length;
 extern const uint8_t renderer_data[];
 
+typedef enum eSceneDecoderStatus {
+    SCENE_DECODER_IDLE,
+    SCENE_DECODER_DECODING,
+    // tables needed to show a screen are decoded (texts may follow)
+    SCENE_DECODER_SCREEN_READY,
+    // texts are published (renderer_texts_count) only when finished, text
+    // calls made earlier just trace an invalid handle
+    SCENE_DECODER_FINISHED,
+    SCENE_DECODER_FAILED
+} eSceneDecoderStatus;
+
+// blocking decoding
 bool scene_decoder_decode(bool custom);
 
+// incremental decoding driven from the main loop
+// (invalid custom scene falls back to the built-in one, the status returns to
+// SCENE_DECODER_DECODING and scene_decoder_use_default() becomes true)
+bool scene_decoder_start(bool custom);
+
+// decodes next part of the scene, returns true if anything was done
+bool scene_decoder_handle();
+
+eSceneDecoderStatus scene_decoder_status();
+
+// memory for the decoded tables (e.g. linker-provided region, NULL restores
+// the built-in one), must be set before the decoding starts
+void scene_decoder_set_memory(void *region, uint32_t size);
+
+// scene memory sizing (bytes)
+#define SCENE_DECODER_SECTIONS          12
+
+typedef struct tSceneDecoderMemory {
+    uint32_t capacity;
+    uint32_t used;
+    // known after the image header for direct images, after decoding otherwise
+    uint32_t required;
+    // used by each section (in the image section order)
+    uint32_t section[SCENE_DECODER_SECTIONS];
+} tSceneDecoderMemory;
+
+void scene_decoder_get_memory(tSceneDecoderMemory *report);
+
 bool scene_decoder_use_default();
 
 void scene_default_init();
@@ -13,11 +13,18 @@ void vc_init();
 
 bool vc_handle();
 
-void vc_set_render_mode(tRendererScreenGraphics* graphics);
+// returns offset of the texture bundle in the texture memory (bytes),
+// bundle already resident is not uploaded again
+uint32_t vc_set_render_mode(const tRendererScreenGraphics* graphics);
 
 void vc_set_playback_mode(tRendererVideoDescriptor* descriptor,
                           rRendererVideoCallback callback,
                           const void* callback_arg);
 
 void vc_set_display_off();
+
+#ifdef VC_READY_IRQ
+// ready line of the video core raised (called from the interrupt handler)
+void vc_ready_interrupt();
+#endif
 #endif //RENDERER_TEST_VIDEO_CORE_H
@@ -8,17 +8,16 @@
 #include "video-core.h"
 #include "window.h"
 #include "profile.h"
+#include "rasterizer.h"
 
 #define SCREEN_WIDTH  640
 #define SCREEN_HEIGHT 480
 
-static void stream_dump(const uint8_t *data, unsigned length);
-
 static void set_geometry(unsigned x, unsigned y, unsigned width, unsigned height);
 
 static void update_vertices();
 
-static void shader_activate_simple(unsigned *aPosition, unsigned *uColor);
+static void shader_activate_simple(unsigned *aPosition, unsigned *uTexture);
 
 #define VERTEX_BUFFER_STRIDE 4
 #define SET_VERTEX(y, x, value) vertices[(y) *VERTEX_BUFFER_STRIDE + (x)] = value
@@ -26,80 +25,59 @@ static GLfloat vertices[6 * VERTEX_BUFFER_STRIDE];
 static GLuint vertex_buffer;
 static float coord_x[4], coord_y[4];
 static GLuint shader;
-static unsigned aPosition, uColor;
-
-static void opengl_render(const uint8_t* data, unsigned length) {
-    unsigned pos;
-    for (pos = 0; pos < length;) {
-        if (data[pos] & 0x80)
-            break;
-
-        unsigned x = ((unsigned) data[pos + 1]) | (((unsigned) data[pos + 2]) << 8);
-        unsigned y = ((unsigned) data[pos + 3]) | (((unsigned) data[pos + 4]) << 8);
-        unsigned w = ((unsigned) data[pos + 5]) | (((unsigned) data[pos + 6]) << 8);
-        unsigned h = ((unsigned) data[pos + 7]) | (((unsigned) data[pos + 8]) << 8);
-        set_geometry(x, y, w, h);
-
-        // select rendering program
-        shader_activate_simple(NULL, NULL);
-
-        // set color
-        uint16_t color = ((uint16_t) data[pos + 9]) | (((uint16_t) data[pos + 10]) << 8);
-        float red = ((float) (color & 0x1f)) / 31.f;
-        float green = ((float) ((color >> 5) & 0x1f)) / 31.f;
-        float blue = ((float) ((color >> 10) & 0x1f)) / 31.f;
-        float alpha = ((float) data[pos + 11]) / 15.f;
-        glUniform4f(uColor, red, green, blue, alpha);
-        // set vertices
-        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-        glVertexAttribPointer(aPosition, 2, GL_FLOAT, GL_FALSE,
-                              VERTEX_BUFFER_STRIDE * sizeof(float), (GLvoid *) 0);
-        glEnableVertexAttribArray(aPosition);
-
-        // render
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-
-        pos += 12;
+static unsigned aPosition, uTexture;
+
+// visible part of the rasterizer framebuffer (RGBA4444)
+static GLuint screen_texture;
+static uint16_t screen_pixels[SCREEN_HEIGHT * SCREEN_WIDTH];
+
+static void opengl_render() {
+    // convert visible framebuffer (r[11:8] g[7:4] b[3:0]) to RGBA4444
+    const uint16_t *framebuffer = rasterizer_framebuffer();
+    unsigned x, y;
+    for (y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint16_t *src = framebuffer + y * RASTERIZER_WIDTH;
+        uint16_t *dst = screen_pixels + y * SCREEN_WIDTH;
+        for (x = 0; x < SCREEN_WIDTH; x++)
+            dst[x] = (src[x] << 4) | 0x0f;
     }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, screen_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT,
+                    GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, screen_pixels);
+
+    // select rendering program
+    shader_activate_simple(NULL, NULL);
+    glUniform1i(uTexture, 0);
+
+    // set vertices
+    set_geometry(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glVertexAttribPointer(aPosition, 2, GL_FLOAT, GL_FALSE,
+                          VERTEX_BUFFER_STRIDE * sizeof(float), (GLvoid *) 0);
+    glEnableVertexAttribArray(aPosition);
+
+    // render
+    glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
 bool vc_cmd_execute(const uint8_t *data, unsigned length) {
     if(length==1 && data[0]==0x80)
         return true;
 
-//    stream_dump(data, length);
+    // execute the command stream as the FPGA does
+    if (!rasterizer_execute(data, length)) {
+        fprintf(stderr, "Malformed command queue (%d bytes)\r\n", length);
+        return false;
+    }
 
-    opengl_render(data, length);
+    opengl_render();
     window_swap_buffers();
 
     return true;
 }
 
-void stream_dump(const uint8_t *data, unsigned length) {
-    unsigned pos;
-    printf("=== Start of list ===\n");
-    for (pos = 0; pos < length;) {
-        if (data[pos] & 0x80) {
-            printf("=== End of list ===\n");
-            break;
-        }
-        printf("Rectangle: x=%d, y=%d, w=%d, h=%d\n",
-               ((unsigned) data[pos + 1]) | (((unsigned) data[pos + 2]) << 8),
-               ((unsigned) data[pos + 3]) | (((unsigned) data[pos + 4]) << 8),
-               ((unsigned) data[pos + 5]) | (((unsigned) data[pos + 6]) << 8),
-               ((unsigned) data[pos + 7]) | (((unsigned) data[pos + 8]) << 8));
-        uint16_t color = ((uint16_t) data[pos + 9]) | (((uint16_t) data[pos + 10]) << 8);
-        printf("  r=%0.3f, g=%0.3f, b=%0.3f, a=%0.3f\n",
-               ((float) (color & 0x1f)) / 31.f,
-               ((float) ((color >> 5) & 0x1f)) / 31.f,
-               ((float) ((color >> 10) & 0x1f)) / 31.f,
-               ((float) data[pos + 11]) / 15.f);
-
-        pos += 12;
-    }
-}
-
 
 static void set_geometry(unsigned x, unsigned y, unsigned width, unsigned height) {
     coord_x[0] = (float) x;
@@ -147,17 +125,20 @@ static void update_vertices() {
 
 #define SIMPLE_SHADER_VERTEX \
 "attribute vec2 aPosition;    \n" \
+"varying vec2 vTexCoord;      \n" \
 "void main()                  \n" \
 "{                            \n" \
 "   gl_Position = vec4(aPosition.x, aPosition.y, 0.0, 1.0);  \n" \
+"   vTexCoord = vec2(aPosition.x + 1.0, 1.0 - aPosition.y) * 0.5;  \n" \
 "}                            \n"
 
 #define SIMPLE_SHADER_FRAGMENT \
 "precision mediump float;\n" \
-"uniform vec4 uColor;\n" \
+"uniform sampler2D uTexture;\n" \
+"varying vec2 vTexCoord;\n" \
 "void main()                                  \n" \
 "{                                            \n" \
-"  gl_FragColor = uColor;\n" \
+"  gl_FragColor = texture2D(uTexture, vTexCoord);\n" \
 "}                                            \n"
 
 
@@ -251,19 +232,30 @@ static void loadShaders(const char *fragmentCode, const char *vertexCode,
 }
 
 static void shader_activate_simple(unsigned *aPosition,
-                                   unsigned *uColor) {
+                                   unsigned *uTexture) {
     glUseProgram(shader);
     if (aPosition)
         *aPosition = glGetAttribLocation(shader, "aPosition");
-    if (uColor)
-        *uColor = glGetUniformLocation(shader, "uColor");
+    if (uTexture)
+        *uTexture = glGetUniformLocation(shader, "uTexture");
 }
 
 void opengl_init() {
     glGenBuffers(1, &vertex_buffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
     loadShaders(SIMPLE_SHADER_FRAGMENT, SIMPLE_SHADER_VERTEX, &shader);
-    shader_activate_simple(&aPosition, &uColor);
+    shader_activate_simple(&aPosition, &uTexture);
+
+    glGenTextures(1, &screen_texture);
+    glBindTexture(GL_TEXTURE_2D, screen_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0,
+                 GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, NULL);
+
+    rasterizer_init();
 }
 
 static bool active_buffer=true;
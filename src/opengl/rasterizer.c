@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <string.h>
+#include "rasterizer.h"
+
+// Software model of the FPGA renderer: CommandProcessor.v decodes the queue,
+// RendererRectFill.v / RendererRectMix.v / RendererTextureMix.v render the rows
+// and RendererMixer.v blends the 4-bit channels. The results are bit-exact.
+
+// command opcodes
+#define OP_RECT                         0x00
+#define OP_RECT_SAME                    0x01
+#define OP_GLYPH                        0x02
+#define OP_GLYPHS                       0x03
+
+#define COORD_MASK                      0x3ff
+#define TEXTURE_ADDRESS_MASK            0xfffff
+
+// command processor registers (kept between commands as in the FPGA)
+static tRasterizerCommand command;
+static rRasterizerCommandCallback command_callback;
+
+static uint16_t framebuffer[RASTERIZER_HEIGHT * RASTERIZER_WIDTH];
+
+static const uint16_t *texture_words;
+static uint32_t texture_word_count;
+
+static tRasterizerStatistics statistics;
+
+// mixer result for every combination of alpha and channel value
+// mix_color[alpha][value]: new color contribution, mix_original[alpha][value]: original color contribution
+static uint8_t mix_color[16][16];
+static uint8_t mix_original[16][16];
+
+static void init_mixer() {
+    unsigned alpha, value;
+    for (alpha = 0; alpha < 16; alpha++) {
+        unsigned alpha1 = (alpha << 4) | alpha;
+        unsigned alpha2 = ((~alpha & 0x0f) << 4) | (~alpha & 0x0f);
+        for (value = 0; value < 16; value++) {
+            mix_color[alpha][value] = ((((alpha1 * value) >> 3) + 17) >> 5) & 0x0f;
+            mix_original[alpha][value] = ((((alpha2 * value) >> 3) + 17) >> 5) & 0x0f;
+        }
+    }
+}
+
+static inline uint16_t mix_channel(unsigned alpha, unsigned color, unsigned original) {
+    unsigned sum = mix_color[alpha][color] + mix_original[alpha][original];
+    return (sum > 15) ? 15 : sum;
+}
+
+void rasterizer_init() {
+    memset(framebuffer, 0, sizeof(framebuffer));
+    memset(&command, 0, sizeof(command));
+    memset(&statistics, 0, sizeof(statistics));
+    init_mixer();
+}
+
+void rasterizer_set_command_callback(rRasterizerCommandCallback callback) {
+    command_callback = callback;
+}
+
+void rasterizer_set_texture_memory(const uint16_t *words, uint32_t count) {
+    texture_words = words;
+    texture_word_count = count;
+}
+
+static inline unsigned texture_alpha(uint32_t address) {
+    uint32_t word_address = (address & TEXTURE_ADDRESS_MASK) >> 2;
+    uint16_t word = (word_address < texture_word_count) ? texture_words[word_address] : 0;
+    return (word >> ((3 - (address & 3)) << 2)) & 0x0f;
+}
+
+// ***********************************************
+// **  ROW KERNELS                              **
+// ***********************************************
+
+static void row_fill(uint16_t *row, unsigned count, uint16_t pixel) {
+    // plain loop, vectorized by the compiler
+    unsigned i;
+    for (i = 0; i < count; i++)
+        row[i] = pixel;
+}
+
+static void row_mix(uint16_t *row, unsigned count, const uint16_t *table) {
+    // the color & alpha are constant -> every original pixel maps to a single result
+    unsigned i;
+    for (i = 0; i < count; i++)
+        row[i] = table[row[i] & 0x0fff];
+}
+
+static void row_texture(uint16_t *row, unsigned count, uint32_t address) {
+    unsigned i;
+    for (i = 0; i < count; i++, address++) {
+        unsigned alpha = texture_alpha(address);
+        uint16_t original = row[i];
+        row[i] = (mix_channel(alpha, command.red, (original >> 8) & 0x0f) << 8)
+                 | (mix_channel(alpha, command.green, (original >> 4) & 0x0f) << 4)
+                 | mix_channel(alpha, command.blue, original & 0x0f);
+    }
+}
+
+// ***********************************************
+// **  RENDERER                                 **
+// ***********************************************
+
+static uint16_t mix_table[4096];
+
+static void render_row(unsigned y, uint32_t texture_address) {
+    uint16_t *row = framebuffer + y * RASTERIZER_WIDTH;
+    unsigned x1 = command.x1, x2 = command.x2;
+
+    // pixel counter wraps at 10 bits
+    unsigned segments = (x2 >= x1) ? 1 : 2;
+    unsigned first_count = (x2 >= x1) ? (x2 + 1 - x1) : (RASTERIZER_WIDTH - x1);
+    unsigned s;
+    for (s = 0; s < segments; s++) {
+        unsigned start = s ? 0 : x1;
+        unsigned count = s ? (x2 + 1) : first_count;
+        if (command.textured) {
+            row_texture(row + start, count, texture_address + (s ? first_count : 0));
+            statistics.textured_pixels += count;
+        } else if (command.alpha == 0x0f) {
+            row_fill(row + start, count,
+                     (command.red << 8) | (command.green << 4) | command.blue);
+            statistics.filled_pixels += count;
+        } else {
+            row_mix(row + start, count, mix_table);
+            statistics.mixed_pixels += count;
+        }
+    }
+}
+
+static void render_command() {
+    statistics.commands++;
+    if (command_callback)
+        command_callback(&command);
+
+    // constant color mixing
+    if (!command.textured && command.alpha != 0x0f) {
+        unsigned original;
+        for (original = 0; original < 4096; original++) {
+            mix_table[original] = (mix_channel(command.alpha, command.red, (original >> 8) & 0x0f) << 8)
+                                  | (mix_channel(command.alpha, command.green, (original >> 4) & 0x0f) << 4)
+                                  | mix_channel(command.alpha, command.blue, original & 0x0f);
+        }
+    }
+
+    // row counter wraps at 10 bits
+    unsigned y = command.y1;
+    uint32_t texture_address = command.texture_base;
+    for (;;) {
+        render_row(y, texture_address);
+        if (y == command.y2)
+            break;
+        y = (y + 1) & COORD_MASK;
+        texture_address = (texture_address + command.texture_stripe) & TEXTURE_ADDRESS_MASK;
+    }
+}
+
+// ***********************************************
+// **  COMMAND PROCESSOR                        **
+// ***********************************************
+
+static void decode_rect(const uint8_t *data) {
+    command.y1 = data[0] | ((data[4] & 0x03) << 8);
+    command.x1 = data[1] | (((data[4] >> 2) & 0x03) << 8);
+    command.y2 = data[2] | (((data[4] >> 4) & 0x03) << 8);
+    command.x2 = data[3] | (((data[4] >> 6) & 0x03) << 8);
+}
+
+static void decode_relative(const uint8_t *data) {
+    command.x1 = (command.x1 + (int8_t) data[0]) & COORD_MASK;
+    command.y1 = (command.y1 + (int8_t) data[1]) & COORD_MASK;
+    command.x2 = (command.x1 + data[2]) & COORD_MASK;
+    command.y2 = (command.y1 + data[3]) & COORD_MASK;
+}
+
+static void decode_base(const uint8_t *data) {
+    command.texture_base = data[0] | (data[1] << 8) | ((data[2] & 0x0f) << 16);
+}
+
+bool rasterizer_execute(const uint8_t *queue, unsigned length) {
+    const uint8_t *end = queue + length;
+    while (queue < end) {
+        uint8_t opcode = *queue++ & 0x03;
+        switch (opcode) {
+            case OP_RECT: {
+                if (end - queue < 8)
+                    return false;
+                decode_rect(queue);
+                uint8_t mode = queue[5];
+                command.textured = mode & 0x01;
+                command.texture_copy = (mode & 0x01) && (mode & 0x02);
+                command.texture_packed = (mode & 0x01) && !(mode & 0x04);
+                command.texture_stripe = (command.texture_stripe & 0xff) | ((mode >> 6) << 8);
+                if (!command.textured) {
+                    command.red = queue[6] & 0x0f;
+                    command.green = queue[6] >> 4;
+                    command.blue = queue[7] & 0x0f;
+                    command.alpha = queue[7] >> 4;
+                    queue += 8;
+                } else {
+                    unsigned command_length = command.texture_packed ? 12 : 10;
+                    if (end - queue < command_length)
+                        return false;
+                    command.texture_stripe = (command.texture_stripe & 0x300) | queue[6];
+                    decode_base(queue + 7);
+                    if (command.texture_packed) {
+                        command.red = queue[10] & 0x0f;
+                        command.green = queue[10] >> 4;
+                        command.blue = queue[11] & 0x0f;
+                        command.alpha = 0;
+                    }
+                    queue += command_length;
+                }
+                render_command();
+                break;
+            }
+
+            case OP_RECT_SAME:
+                if (end - queue < 4)
+                    return false;
+                decode_relative(queue);
+                queue += 4;
+                render_command();
+                break;
+
+            case OP_GLYPH:
+            case OP_GLYPHS: {
+                unsigned count = 1;
+                if (opcode == OP_GLYPHS) {
+                    if (queue == end)
+                        return false;
+                    count += *queue++;
+                }
+                command.textured = true;
+                while (count--) {
+                    if (end - queue < 7)
+                        return false;
+                    decode_relative(queue);
+                    decode_base(queue + 4);
+                    queue += 7;
+                    render_command();
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+const uint16_t *rasterizer_framebuffer() {
+    return framebuffer;
+}
+
+void rasterizer_get_statistics(tRasterizerStatistics *stats) {
+    *stats = statistics;
+}
+
+bool rasterizer_dump(const char *file_name, unsigned width, unsigned height) {
+    if (width > RASTERIZER_WIDTH || height > RASTERIZER_HEIGHT)
+        return false;
+    FILE *file = fopen(file_name, "wb");
+    if (!file)
+        return false;
+    fprintf(file, "P6\n%u %u\n15\n", width, height);
+    unsigned x, y;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint16_t pixel = framebuffer[y * RASTERIZER_WIDTH + x];
+            uint8_t rgb[3] = {(pixel >> 8) & 0x0f, (pixel >> 4) & 0x0f, pixel & 0x0f};
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef RENDERER_RASTERIZER_H
+#define RENDERER_RASTERIZER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 10-bit coordinates
+#define RASTERIZER_WIDTH                1024
+#define RASTERIZER_HEIGHT               1024
+
+// Pixels are kept as in the video RAM: 4 bits per channel, red [11:8],
+// green [7:4], blue [3:0] (channels named as in the FPGA design).
+
+typedef struct tRasterizerStatistics {
+    uint32_t commands;
+    // pixels written by color fill (alpha 15)
+    uint32_t filled_pixels;
+    // pixels mixed with color alpha
+    uint32_t mixed_pixels;
+    // pixels mixed with texture alpha
+    uint32_t textured_pixels;
+} tRasterizerStatistics;
+
+// command as decoded by the command processor (registers of CommandProcessor.v,
+// kept between the commands)
+typedef struct tRasterizerCommand {
+    unsigned x1, y1, x2, y2;
+    uint8_t red, green, blue, alpha;
+    bool textured;
+    bool texture_packed;
+    bool texture_copy;
+    unsigned texture_stripe;
+    uint32_t texture_base;
+} tRasterizerCommand;
+
+typedef void (*rRasterizerCommandCallback)(const tRasterizerCommand *command);
+
+void rasterizer_init();
+
+// called with every decoded command before it is rendered (NULL: none)
+void rasterizer_set_command_callback(rRasterizerCommandCallback callback);
+
+// texture memory (16-bit words, 4 alpha values per word)
+void rasterizer_set_texture_memory(const uint16_t *words, uint32_t count);
+
+// executes the command queue (as sent by the renderer), returns false on malformed queue
+bool rasterizer_execute(const uint8_t *queue, unsigned length);
+
+const uint16_t *rasterizer_framebuffer();
+
+void rasterizer_get_statistics(tRasterizerStatistics *statistics);
+
+// writes the framebuffer area as binary PPM image
+bool rasterizer_dump(const char *file_name, unsigned width, unsigned height);
+
+#endif //RENDERER_RASTERIZER_H
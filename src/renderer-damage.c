@@ -0,0 +1,190 @@
+#include "renderer-damage.h"
+
+// pending fragments of the area being added
+#define STACK_SIZE              16
+
+// steps after which only merging is allowed (merging always terminates)
+#define SPLIT_BUDGET            64
+
+static inline uint32_t area_pixels(const tRectangle *r) {
+    return ((uint32_t) (r->x2 + 1 - r->x1)) * ((uint32_t) (r->y2 + 1 - r->y1));
+}
+
+static inline uint32_t area_cost(const tRectangle *r) {
+    return RENDERER_DAMAGE_AREA_COST + area_pixels(r);
+}
+
+static inline bool overlaps(const tRectangle *a, const tRectangle *b) {
+    return !(a->x2 < b->x1 || a->x1 > b->x2 || a->y2 < b->y1 || a->y1 > b->y2);
+}
+
+static inline bool contains(const tRectangle *outer, const tRectangle *inner) {
+    return outer->x1 <= inner->x1 && outer->x2 >= inner->x2
+           && outer->y1 <= inner->y1 && outer->y2 >= inner->y2;
+}
+
+static inline void bounding_box(const tRectangle *a, const tRectangle *b, tRectangle *box) {
+    box->x1 = (a->x1 < b->x1) ? a->x1 : b->x1;
+    box->x2 = (a->x2 > b->x2) ? a->x2 : b->x2;
+    box->y1 = (a->y1 < b->y1) ? a->y1 : b->y1;
+    box->y2 = (a->y2 > b->y2) ? a->y2 : b->y2;
+}
+
+// splits area to the parts not covered by the (overlapping) cut
+static unsigned subtract(const tRectangle *area, const tRectangle *cut, tRectangle *parts) {
+    unsigned count = 0;
+    tRendererPosition y1 = (area->y1 > cut->y1) ? area->y1 : cut->y1;
+    tRendererPosition y2 = (area->y2 < cut->y2) ? area->y2 : cut->y2;
+    if (area->y1 < y1) {
+        parts[count].x1 = area->x1;
+        parts[count].x2 = area->x2;
+        parts[count].y1 = area->y1;
+        parts[count].y2 = y1 - 1;
+        count++;
+    }
+    if (area->x1 < cut->x1) {
+        parts[count].x1 = area->x1;
+        parts[count].x2 = cut->x1 - 1;
+        parts[count].y1 = y1;
+        parts[count].y2 = y2;
+        count++;
+    }
+    if (area->x2 > cut->x2) {
+        parts[count].x1 = cut->x2 + 1;
+        parts[count].x2 = area->x2;
+        parts[count].y1 = y1;
+        parts[count].y2 = y2;
+        count++;
+    }
+    if (area->y2 > y2) {
+        parts[count].x1 = area->x1;
+        parts[count].x2 = area->x2;
+        parts[count].y1 = y2 + 1;
+        parts[count].y2 = area->y2;
+        count++;
+    }
+    return count;
+}
+
+static inline void remove_area(tDamageList *list, unsigned index) {
+    list->area[index] = list->area[--list->count];
+}
+
+void renderer_damage_reset(tDamageList *list) {
+    list->count = 0;
+    list->requested_areas = 0;
+    list->requested_pixels = 0;
+}
+
+void renderer_damage_add(tDamageList *list, const tRectangle *area) {
+    // empty area?
+    if (area->x2 < area->x1 || area->y2 < area->y1)
+        return;
+    list->requested_areas++;
+    list->requested_pixels += area_pixels(area);
+
+    tRectangle stack[STACK_SIZE];
+    unsigned stack_size = 0;
+    tRectangle current = *area;
+    unsigned steps = 0;
+
+    for (;;) {
+        unsigned i;
+        bool resolved = false;
+        bool allow_split = ++steps < SPLIT_BUDGET;
+
+        // find an overlapping area
+        for (i = 0; i < list->count; i++) {
+            if (overlaps(list->area + i, &current))
+                break;
+        }
+
+        if (i < list->count) {
+            tRectangle *existing = list->area + i;
+            if (contains(existing, &current)) {
+                // already damaged
+                resolved = true;
+            } else if (contains(&current, existing)) {
+                // swallow existing
+                remove_area(list, i);
+            } else {
+                // merge or split?
+                tRectangle box;
+                tRectangle parts[4];
+                bounding_box(existing, &current, &box);
+                unsigned count = subtract(&current, existing, parts), j;
+                uint32_t split_cost = area_cost(existing);
+                for (j = 0; j < count; j++)
+                    split_cost += area_cost(parts + j);
+                if (area_cost(&box) <= split_cost || stack_size + count > STACK_SIZE || !allow_split) {
+                    remove_area(list, i);
+                    current = box;
+                } else {
+                    current = parts[0];
+                    for (j = 1; j < count; j++)
+                        stack[stack_size++] = parts[j];
+                }
+            }
+        } else {
+            // no overlap -> merge with a neighbour if cheaper
+            // (only when the merged area does not hit another area)
+            unsigned best = list->count;
+            uint32_t best_gain = 0;
+            for (i = 0; i < list->count; i++) {
+                tRectangle box;
+                bounding_box(list->area + i, &current, &box);
+                uint32_t separate = area_cost(list->area + i) + area_cost(&current);
+                uint32_t merged = area_cost(&box);
+                if (merged > separate || (best != list->count && separate - merged <= best_gain))
+                    continue;
+                unsigned j;
+                for (j = 0; j < list->count; j++) {
+                    if (j != i && overlaps(list->area + j, &box))
+                        break;
+                }
+                if (j != list->count)
+                    continue;
+                best = i;
+                best_gain = separate - merged;
+            }
+
+            // list full -> merge with the cheapest
+            if (best == list->count && list->count == RENDERER_DAMAGE_MAX_AREAS) {
+                uint32_t best_loss = 0;
+                for (i = 0; i < list->count; i++) {
+                    tRectangle box;
+                    bounding_box(list->area + i, &current, &box);
+                    uint32_t loss = area_cost(&box) - area_cost(list->area + i);
+                    if (best == list->count || loss < best_loss) {
+                        best = i;
+                        best_loss = loss;
+                    }
+                }
+            }
+
+            if (best != list->count) {
+                tRectangle box;
+                bounding_box(list->area + best, &current, &box);
+                remove_area(list, best);
+                current = box;
+            } else {
+                list->area[list->count++] = current;
+                resolved = true;
+            }
+        }
+
+        if (resolved) {
+            if (!stack_size)
+                return;
+            current = stack[--stack_size];
+        }
+    }
+}
+
+uint32_t renderer_damage_pixels(const tDamageList *list) {
+    uint32_t pixels = 0;
+    unsigned i;
+    for (i = 0; i < list->count; i++)
+        pixels += area_pixels(list->area + i);
+    return pixels;
+}
@@ -0,0 +1,42 @@
+#ifndef RENDERER_RENDERER_DAMAGE_H
+#define RENDERER_RENDERER_DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "renderer-definition.h"
+
+// maximal number of (non-overlapping) areas redrawn in one frame
+#ifndef RENDERER_DAMAGE_MAX_AREAS
+#define RENDERER_DAMAGE_MAX_AREAS       32
+#endif
+
+// cost of an extra area expressed in pixels (command headers sent over SPI
+// for every tile in the area + FPGA command setup), the higher the cost the
+// more the areas get merged into bounding boxes rather than split
+#ifndef RENDERER_DAMAGE_AREA_COST
+#define RENDERER_DAMAGE_AREA_COST       512
+#endif
+
+typedef struct tRectangle {
+    tRendererPosition x1;
+    tRendererPosition x2;
+    tRendererPosition y1;
+    tRendererPosition y2;
+} tRectangle;
+
+typedef struct tDamageList {
+    unsigned count;
+    tRectangle area[RENDERER_DAMAGE_MAX_AREAS];
+    // statistics
+    uint32_t requested_areas;
+    uint32_t requested_pixels;
+} tDamageList;
+
+void renderer_damage_reset(tDamageList *list);
+
+// adds the area, the list is kept free of overlapping areas
+void renderer_damage_add(tDamageList *list, const tRectangle *area);
+
+uint32_t renderer_damage_pixels(const tDamageList *list);
+
+#endif //RENDERER_RENDERER_DAMAGE_H
@@ -2,38 +2,82 @@
 // Created by tumap on 8/2/22.
 //
 #include <stdbool.h>
+#include <profile.h>
+#include <renderer.h>
 #include <renderer-scene.h>
 #include <video-core.h>
+#include "renderer-index.h"
+#include "renderer-damage.h"
 #include "memcpy.h"
 #include "trace.h"
 
 extern tRendererTileHandle root_tile;
 
-// allocate memory
-static uint8_t tile_cache_mem[16 * 1024];
-
-// a local copy of graphics scene as it was last rendered
+// a compact copy of the hot tile state as it was last rendered
 // used for detecting the changes as only these are actually rendered
 typedef struct tVideoBuffer {
     bool not_rendered_at_all;
-    tRendererTile *tile_cache;
+    tRendererRect rects[RENDERER_MAX_TILES];
+    tRendererAppearance appearance[RENDERER_MAX_TILES];
+    uint32_t shown[RENDERER_BITMAP_WORDS(RENDERER_MAX_TILES)];
 } tVideoBuffer;
 static tVideoBuffer buffer;
 
+// tiles of the current screen (tile tree of the root tile)
+static uint32_t screen_tiles[RENDERER_BITMAP_WORDS(RENDERER_MAX_TILES)];
 
-static tTime refresh_timer;
-#define REFRESH_TIMER           250
+// the screen is repaired by repainting a band of lines every scrub period
+// rotating over the whole screen (0 lines disables scrubbing)
+#ifndef RENDERER_SCRUB_LINES
+#define RENDERER_SCRUB_LINES    32
+#endif
+#ifndef RENDERER_SCRUB_PERIOD
+#define RENDERER_SCRUB_PERIOD   50
+#endif
+static tTime scrub_timer;
+static tRendererPosition scrub_line;
 
 
 tRendererTileHandle root_tile;
 tRendererGraphicsHandle graphics_handle;
 
+// texture bundle position in the texture memory (texture address units)
+static uint32_t texture_offset;
+
 
 static void update_tile_cache();
 
 
 
-void vc_cmd_rect_color(tRendererPosition left,
+// command opcodes (first byte of every command)
+#define VC_OP_RECT                      0x00    // full rectangle command follows
+#define VC_OP_RECT_SAME                 0x01    // relative rectangle, color as previous
+#define VC_OP_GLYPH                     0x02    // relative rectangle & texture base, stripe & color as previous
+#define VC_OP_GLYPHS                    0x03    // glyph count - 1 & relative glyphs follow
+
+// command lengths
+#define VC_CMD_RECT_COLOR_LENGTH        9
+#define VC_CMD_RECT_TEXTURE_LENGTH      13
+#define VC_CMD_RECT_SAME_LENGTH         5
+#define VC_CMD_GLYPH_LENGTH             8
+#define VC_CMD_GLYPH_BODY_LENGTH        7
+
+// state of the command processor after the previous command in the queue
+// (every queue starts with a full command, the queue is rendered into both banks)
+typedef struct tCommandEncoder {
+    bool valid;
+    bool textured;
+    tRendererPosition left;
+    tRendererPosition top;
+    uint16_t color;
+    uint16_t stripe_length;
+    // last glyph command and glyphs in it (0 when previous command is not a glyph)
+    uint16_t glyphs_position;
+    unsigned glyphs_count;
+} tCommandEncoder;
+static tCommandEncoder encoder;
+
+bool vc_cmd_rect_color(tRendererPosition left,
                        tRendererPosition top,
                        tRendererPosition width,
                        tRendererPosition height,
@@ -42,7 +86,7 @@ void vc_cmd_rect_color(tRendererPosition left,
                        uint16_t max_length,
                        uint16_t *length);
 
-static void vc_cmd_rect_texture(tRendererPosition left,
+static bool vc_cmd_rect_texture(tRendererPosition left,
                                 tRendererPosition top,
                                 tRendererPosition width,
                                 tRendererPosition height,
@@ -55,12 +99,8 @@ static void vc_cmd_rect_texture(tRendererPosition left,
                                 uint16_t *length);
 
 
-typedef struct tRectangle {
-    tRendererPosition x1;
-    tRendererPosition x2;
-    tRendererPosition y1;
-    tRendererPosition y2;
-} tRectangle;
+// tiles found by the spatial index
+static tRendererTileHandle area_tiles[RENDERER_MAX_TILES];
 
 #define REDRAW_LIST_SIZE        5
 typedef struct tRedrawList {
@@ -68,25 +108,61 @@ typedef struct tRedrawList {
     tRectangle area[REDRAW_LIST_SIZE];
 } tRedrawList;
 
+// all areas to be redrawn in the frame
+static tDamageList damage;
+
+// first area not sent yet (frame split into several queues)
+static unsigned pending_area;
+
+static tRendererStatistics statistics;
+
 void renderer_init() {
     root_tile = RENDERER_NULL_HANDLE;
     graphics_handle = RENDERER_NULL_HANDLE;
-    buffer.tile_cache = (tRendererTile *) tile_cache_mem;
-    refresh_timer = 0;
+    texture_offset = 0;
+    scrub_timer = 0;
+    scrub_line = 0;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void renderer_reset() {
+    root_tile = RENDERER_NULL_HANDLE;
+    // textures of the next screen are uploaded again
+    graphics_handle = RENDERER_NULL_HANDLE;
+    memset(screen_tiles, 0, sizeof(screen_tiles));
+    memset(renderer_tile_dirty, 0, sizeof(renderer_tile_dirty));
+    renderer_tiles_dirty = false;
+    renderer_index_reset();
+    renderer_damage_reset(&damage);
+    pending_area = 0;
+    buffer.not_rendered_at_all = true;
+}
+
+// tiles of the current screen being rendered (root tile is always rendered)
+static inline uint32_t shown_tiles(unsigned word) {
+    uint32_t shown = renderer_tile_visible[word] & renderer_tile_parent_visible[word];
+    if (word == (root_tile >> 5))
+        shown |= ((uint32_t) 1) << (root_tile & 31);
+    return shown & screen_tiles[word];
+}
+
+static inline void set_area(tRectangle *area, const tRendererRect *rect) {
+    area->x1 = rect->left;
+    area->x2 = rect->right;
+    area->y1 = rect->top;
+    area->y2 = rect->bottom;
 }
 
 static void compute_area_to_redraw(tVideoBuffer *buffer,
-                                   tRendererTile *tile,
                                    tRendererTileHandle tile_handle,
+                                   bool tile_visible,
+                                   bool cache_visible,
                                    tRedrawList *list) {
-    register tRendererTile *cache = buffer->tile_cache + tile_handle;
-
-    // visibility has changed?
-    register bool tile_visible = tile->tile_visible && tile->parent_visible;
-    register bool cache_visible = cache->tile_visible && cache->parent_visible;
+    register const tRendererRect *tile = renderer_tile_rects + tile_handle;
+    register const tRendererRect *cache = buffer->rects + tile_handle;
 
     // tile not visible and has not been?
-    if (!tile_visible && !cache_visible && !buffer->not_rendered_at_all) {
+    if (!tile_visible && !cache_visible) {
         // nothing to draw
         list->count = 0;
         return;
@@ -95,11 +171,8 @@ static void compute_area_to_redraw(tVideoBuffer *buffer,
     // tile is visible and has not been?
     if ((tile_visible && !cache_visible) || buffer->not_rendered_at_all) {
         // redraw entire rectangle
-        list->count = 1;
-        list->area[0].x1 = tile->position_left;
-        list->area[0].x2 = tile->position_right;
-        list->area[0].y1 = tile->position_top;
-        list->area[0].y2 = tile->position_bottom;
+        list->count = tile_visible ? 1 : 0;
+        set_area(list->area, tile);
         return;
     }
 
@@ -107,77 +180,60 @@ static void compute_area_to_redraw(tVideoBuffer *buffer,
     if (!tile_visible && cache_visible) {
         // redraw entire previous rectangle
         list->count = 1;
-        list->area[0].x1 = cache->position_left;
-        list->area[0].x2 = cache->position_right;
-        list->area[0].y1 = cache->position_top;
-        list->area[0].y2 = cache->position_bottom;
+        set_area(list->area, cache);
         return;
     }
 
     // tile is visible and has been
 
     // position has changed?
-    if (tile->position_left != cache->position_left
-        || tile->position_width != cache->position_width
-        || tile->position_top != cache->position_top
-        || tile->position_height != cache->position_height) {
+    if (tile->left != cache->left
+        || tile->right != cache->right
+        || tile->top != cache->top
+        || tile->bottom != cache->bottom) {
         // redraw entire new rectangle
-        list->area[0].x1 = tile->position_left;
-        list->area[0].x2 = tile->position_right;
-        list->area[0].y1 = tile->position_top;
-        list->area[0].y2 = tile->position_bottom;
+        set_area(list->area, tile);
         list->count = 1;
 
         // check intersection
-        if (tile->position_left > cache->position_right
-            || tile->position_right < cache->position_left
-            || tile->position_top > cache->position_bottom
-            || tile->position_bottom < cache->position_top) {
+        if (tile->left > cache->right
+            || tile->right < cache->left
+            || tile->top > cache->bottom
+            || tile->bottom < cache->top) {
             // no intersection -> redraw entire previous rectangle
             list->count = 2;
-            list->area[1].x1 = cache->position_left;
-            list->area[1].x2 = cache->position_right;
-            list->area[1].y1 = cache->position_top;
-            list->area[1].y2 = cache->position_bottom;
+            set_area(list->area + 1, cache);
         } else {
-            register tRendererPosition x1 = (tile->position_left > cache->position_left)
-                                            ? tile->position_left
-                                            : cache->position_left;
-            register tRendererPosition x2 = (tile->position_right < cache->position_right)
-                                            ? tile->position_right
-                                            : cache->position_right;
-            register tRendererPosition y1 = (tile->position_top > cache->position_top)
-                                            ? tile->position_top
-                                            : cache->position_top;
-            register tRendererPosition y2 = (tile->position_bottom < cache->position_bottom)
-                                            ? tile->position_bottom
-                                            : cache->position_bottom;
-            if (cache->position_top < y1) {
-                list->area[list->count].x1 = cache->position_left;
-                list->area[list->count].x2 = cache->position_right;
-                list->area[list->count].y1 = cache->position_top;
+            register tRendererPosition x1 = (tile->left > cache->left) ? tile->left : cache->left;
+            register tRendererPosition x2 = (tile->right < cache->right) ? tile->right : cache->right;
+            register tRendererPosition y1 = (tile->top > cache->top) ? tile->top : cache->top;
+            register tRendererPosition y2 = (tile->bottom < cache->bottom) ? tile->bottom : cache->bottom;
+            if (cache->top < y1) {
+                list->area[list->count].x1 = cache->left;
+                list->area[list->count].x2 = cache->right;
+                list->area[list->count].y1 = cache->top;
                 list->area[list->count].y2 = y1 - 1;
                 list->count++;
             }
-            if (cache->position_left < x1) {
-                list->area[list->count].x1 = cache->position_left;
+            if (cache->left < x1) {
+                list->area[list->count].x1 = cache->left;
                 list->area[list->count].x2 = x1 - 1;
                 list->area[list->count].y1 = y1;
                 list->area[list->count].y2 = y2;
                 list->count++;
             }
-            if (cache->position_right > x2) {
+            if (cache->right > x2) {
                 list->area[list->count].x1 = x2 + 1;
-                list->area[list->count].x2 = cache->position_right;
+                list->area[list->count].x2 = cache->right;
                 list->area[list->count].y1 = y1;
                 list->area[list->count].y2 = y2;
                 list->count++;
             }
-            if (cache->position_bottom > y2) {
-                list->area[list->count].x1 = cache->position_left;
-                list->area[list->count].x2 = cache->position_right;
+            if (cache->bottom > y2) {
+                list->area[list->count].x1 = cache->left;
+                list->area[list->count].x2 = cache->right;
                 list->area[list->count].y1 = y2 + 1;
-                list->area[list->count].y2 = cache->position_bottom;
+                list->area[list->count].y2 = cache->bottom;
                 list->count++;
             }
         }
@@ -185,19 +241,10 @@ static void compute_area_to_redraw(tVideoBuffer *buffer,
     }
 
     // color or texture has changed?
-    if (cache->color.blue != tile->color.blue
-        || cache->color.green != tile->color.green
-        || cache->color.red != tile->color.red
-        || cache->color.alpha != tile->color.alpha
-        || cache->texture.packed_alpha != tile->texture.packed_alpha
-        || cache->texture.base != tile->texture.base
-        || cache->texture.stripe_length != tile->texture.stripe_length) {
+    if (!renderer_appearance_equal(renderer_tile_appearance + tile_handle, buffer->appearance + tile_handle)) {
         // redraw current rectangle
         list->count = 1;
-        list->area[0].x1 = tile->position_left;
-        list->area[0].x2 = tile->position_right;
-        list->area[0].y1 = tile->position_top;
-        list->area[0].y2 = tile->position_bottom;
+        set_area(list->area, tile);
         return;
     }
 
@@ -205,76 +252,273 @@ static void compute_area_to_redraw(tVideoBuffer *buffer,
     list->count = 0;
 }
 
-static void redraw_tile(tVideoBuffer *buffer, tRendererTile *tile,
-                        tRectangle *bounding_box,
-                        uint8_t *queue_data, uint16_t queue_size,
-                        uint16_t *queue_length) {
-    // out of bounding box?
-    if (tile->position_right < bounding_box->x1
-        || tile->position_left > bounding_box->x2
-        || tile->position_bottom < bounding_box->y1
-        || tile->position_top > bounding_box->y2)
-        return;
+static bool draw_tile(tRendererTileHandle tile_handle,
+                      tRectangle *bounding_box,
+                      uint8_t *queue_data, uint16_t queue_size,
+                      uint16_t *queue_length) {
+    tRendererTile *tile = renderer_tiles + tile_handle;
+    const tRendererRect *rect = renderer_tile_rects + tile_handle;
 
     // compute intersection
-    tRendererPosition x1 = (tile->position_left < bounding_box->x1) ? bounding_box->x1 : tile->position_left;
-    tRendererPosition x2 = (tile->position_right > bounding_box->x2) ? bounding_box->x2 : tile->position_right;
-    tRendererPosition y1 = (tile->position_top < bounding_box->y1) ? bounding_box->y1 : tile->position_top;
-    tRendererPosition y2 = (tile->position_bottom > bounding_box->y2) ? bounding_box->y2 : tile->position_bottom;
+    tRendererPosition x1 = (rect->left < bounding_box->x1) ? bounding_box->x1 : rect->left;
+    tRendererPosition x2 = (rect->right > bounding_box->x2) ? bounding_box->x2 : rect->right;
+    tRendererPosition y1 = (rect->top < bounding_box->y1) ? bounding_box->y1 : rect->top;
+    tRendererPosition y2 = (rect->bottom > bounding_box->y2) ? bounding_box->y2 : rect->bottom;
 
     // render color rectangle
+    bool fits;
     switch (tile->rendering_mode) {
         case ALPHA_TEXTURE:
-            vc_cmd_rect_texture(x1, y1, x2 + 1 - x1, y2 + 1 - y1,
-                                tile->color,
-                                &tile->texture,
-                                x1 - tile->position_left,
-                                y1 - tile->position_top,
-                                queue_data, queue_size, queue_length);
+            fits = vc_cmd_rect_texture(x1, y1, x2 + 1 - x1, y2 + 1 - y1,
+                                       tile->color,
+                                       &tile->texture,
+                                       x1 - rect->left,
+                                       y1 - rect->top,
+                                       queue_data, queue_size, queue_length);
             break;
         case COLOR:
         default:
-            vc_cmd_rect_color(x1, y1, x2 + 1 - x1, y2 + 1 - y1, tile->color,
-                              queue_data, queue_size, queue_length);
+            fits = vc_cmd_rect_color(x1, y1, x2 + 1 - x1, y2 + 1 - y1, tile->color,
+                                     queue_data, queue_size, queue_length);
             break;
     }
+    if (fits)
+        statistics.commands++;
+    return fits;
+}
+
+static bool redraw_tile(tRendererTileHandle tile_handle,
+                        tRectangle *bounding_box,
+                        uint8_t *queue_data, uint16_t queue_size,
+                        uint16_t *queue_length) {
+    const tRendererRect *rect = renderer_tile_rects + tile_handle;
+
+    // out of bounding box?
+    if (rect->right < bounding_box->x1
+        || rect->left > bounding_box->x2
+        || rect->bottom < bounding_box->y1
+        || rect->top > bounding_box->y2)
+        return true;
+
+    if (!draw_tile(tile_handle, bounding_box, queue_data, queue_size, queue_length))
+        return false;
 
     // render all children
+    tRendererTile *tile = renderer_tiles + tile_handle;
     unsigned i;
     for (i = 0; i < tile->children_count; i++) {
-        tRendererTile *child = renderer_tiles + renderer_child_index[tile->children_list_index + i];
-        if (child->tile_visible)
-            redraw_tile(buffer, child, bounding_box, queue_data, queue_size, queue_length);
+        tRendererTileHandle child = renderer_child_index[tile->children_list_index + i];
+        if (renderer_bit_get(renderer_tile_visible, child)
+            && !redraw_tile(child, bounding_box, queue_data, queue_size, queue_length))
+            return false;
     }
+    return true;
+}
+
+static unsigned query_area(tRectangle *bounding_box) {
+    // tiles overlapping the area (in rendering order)
+    unsigned count = renderer_index_query(bounding_box->x1, bounding_box->y1,
+                                          bounding_box->x2, bounding_box->y2,
+                                          area_tiles);
+    // drop invisible tiles (root tile is always rendered)
+    unsigned i, visible = 0;
+    for (i = 0; i < count; i++) {
+        if (area_tiles[i] == root_tile || renderer_tile_shown(area_tiles[i]))
+            area_tiles[visible++] = area_tiles[i];
+    }
+    return visible;
+}
 
+// color tile with full alpha
+static inline bool tile_opaque(tRendererTileHandle tile_handle) {
+    return (renderer_tile_appearance[tile_handle].color & 0x3000f) == ((COLOR << 16) | 0x0f);
+}
 
+// shrinks the area by the parts hidden under opaque tiles rendered later,
+// returns false when the area is hidden completely
+static bool occlude_area(tRectangle *area, unsigned first, unsigned count) {
+    bool changed;
+    do {
+        changed = false;
+        unsigned i;
+        for (i = first; i < count; i++) {
+            if (!tile_opaque(area_tiles[i]))
+                continue;
+            const tRendererRect *tile = renderer_tile_rects + area_tiles[i];
+            if (tile->right < area->x1
+                || tile->left > area->x2
+                || tile->bottom < area->y1
+                || tile->top > area->y2)
+                continue;
+            bool covers_x = tile->left <= area->x1 && tile->right >= area->x2;
+            bool covers_y = tile->top <= area->y1 && tile->bottom >= area->y2;
+            if (covers_x && covers_y)
+                return false;
+            if (covers_x) {
+                // hides top or bottom part?
+                if (tile->top <= area->y1) {
+                    area->y1 = tile->bottom + 1;
+                    changed = true;
+                } else if (tile->bottom >= area->y2) {
+                    area->y2 = tile->top - 1;
+                    changed = true;
+                }
+            } else if (covers_y) {
+                // hides left or right part?
+                if (tile->left <= area->x1) {
+                    area->x1 = tile->right + 1;
+                    changed = true;
+                } else if (tile->right >= area->x2) {
+                    area->x2 = tile->left - 1;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+    return true;
 }
 
-static void render_tile(tVideoBuffer *buffer, tRendererTileHandle tile_handle,
+static bool redraw_area(tRectangle *bounding_box,
                         uint8_t *queue_data, uint16_t queue_size,
                         uint16_t *queue_length) {
-    static tRedrawList list;
-    tRendererTile *tile = renderer_tiles + tile_handle;
+    unsigned count = query_area(bounding_box);
+    unsigned first = 0, i;
+
+    // skip everything under the topmost opaque tile covering entire area
+    for (i = count; i > 0; i--) {
+        const tRendererRect *tile = renderer_tile_rects + area_tiles[i - 1];
+        if (tile_opaque(area_tiles[i - 1])
+            && tile->left <= bounding_box->x1 && tile->right >= bounding_box->x2
+            && tile->top <= bounding_box->y1 && tile->bottom >= bounding_box->y2) {
+            first = i - 1;
+            break;
+        }
+    }
+    statistics.occluded_commands += first;
+
+    for (i = first; i < count; i++) {
+        const tRendererRect *tile = renderer_tile_rects + area_tiles[i];
+
+        // visible part of the tile
+        tRectangle visible;
+        visible.x1 = (tile->left < bounding_box->x1) ? bounding_box->x1 : tile->left;
+        visible.x2 = (tile->right > bounding_box->x2) ? bounding_box->x2 : tile->right;
+        visible.y1 = (tile->top < bounding_box->y1) ? bounding_box->y1 : tile->top;
+        visible.y2 = (tile->bottom > bounding_box->y2) ? bounding_box->y2 : tile->bottom;
+        if (!occlude_area(&visible, i + 1, count)) {
+            statistics.occluded_commands++;
+            continue;
+        }
 
-    // compute redraw areas
-    compute_area_to_redraw(buffer, tile, tile_handle, &list);
+        if (!draw_tile(area_tiles[i], &visible, queue_data, queue_size, queue_length))
+            return false;
+    }
+    return true;
+}
 
-    if (list.count != 0) {
-        // redraw areas
-        unsigned i;
-        for (i = 0; i < list.count; i++)
-            redraw_tile(buffer, renderer_tiles + tile->root_tile, list.area + i,
-                        queue_data, queue_size, queue_length);
-    } else {
-        // render children?
-        if (tile->tile_visible) {
+// redraws the pending areas, areas are never split between two queues unless
+// a single area does not fit into an empty queue (it is rendered by parts then)
+// returns false when the frame continues in the next queue
+static bool redraw_pending(uint8_t *queue_data, uint16_t queue_size,
+                           uint16_t *queue_length) {
+    while (pending_area < damage.count) {
+        tRectangle *area = damage.area + pending_area;
+        tRectangle part = *area;
+        for (;;) {
+            // glyph batch of the previous area is not extended (its header
+            // lies before the mark, out of reach of the rollback)
+            encoder.glyphs_count = 0;
+            uint16_t mark = *queue_length;
+            tCommandEncoder encoder_mark = encoder;
+            uint32_t commands = statistics.commands;
+            uint32_t occluded_commands = statistics.occluded_commands;
+            if (renderer_index_valid()
+                ? redraw_area(&part, queue_data, queue_size, queue_length)
+                : redraw_tile(root_tile, &part, queue_data, queue_size, queue_length))
+                break;
+
+            // queue full -> roll the area back (the encoder too, the next
+            // command follows the one before the mark)
+            *queue_length = mark;
+            encoder = encoder_mark;
+            statistics.commands = commands;
+            statistics.occluded_commands = occluded_commands;
+            if (mark)
+                return false;
+            if (part.y1 == part.y2) {
+                TRACE("RendererUpdateDisplay: Area line %d does not fit into queue", part.y1)
+                break;
+            }
+            part.y2 = part.y1 + (part.y2 - part.y1) / 2;
+        }
+
+        // rest of the area remains pending
+        if (part.y2 < area->y2)
+            area->y1 = part.y2 + 1;
+        else
+            pending_area++;
+    }
+    return true;
+}
+
+static void collect_damage(tVideoBuffer *buffer) {
+    static tRedrawList list;
+    unsigned words = RENDERER_BITMAP_WORDS(renderer_tiles_count), word;
+    for (word = 0; word < words; word++) {
+        // nothing changed?
+        if (!renderer_tile_dirty[word] && !buffer->not_rendered_at_all)
+            continue;
+
+        // changed tiles shown now or last time (everything shown when redrawing all)
+        uint32_t shown = shown_tiles(word);
+        uint32_t cache_shown = buffer->shown[word];
+        uint32_t candidates = buffer->not_rendered_at_all
+                              ? shown
+                              : (renderer_tile_dirty[word] & (shown | cache_shown));
+        while (candidates) {
+            unsigned bit = __builtin_ctz(candidates);
+            uint32_t mask = ((uint32_t) 1) << bit;
+            candidates &= candidates - 1;
+
+            // compute redraw areas
+            compute_area_to_redraw(buffer, (word << 5) + bit,
+                                   (shown & mask) != 0, (cache_shown & mask) != 0,
+                                   &list);
+
+            // collect areas
             unsigned i;
-            for (i = 0; i < tile->children_count; i++)
-                render_tile(buffer, renderer_child_index[tile->children_list_index + i],
-                            queue_data, queue_size, queue_length);
+            for (i = 0; i < list.count; i++) {
+                renderer_damage_add(&damage, list.area + i);
+#ifdef RENDERER_DAMAGE_STATISTICS
+                if (renderer_index_valid())
+                    statistics.requested_commands += query_area(list.area + i);
+#endif
+            }
         }
     }
+}
 
+// next band of the screen to be repainted
+static bool scrub_area(tRectangle *area) {
+#if RENDERER_SCRUB_LINES > 0
+    if (scrub_timer > TIME_GET)
+        return false;
+    scrub_timer = TIME_GET + RENDERER_SCRUB_PERIOD;
+
+    const tRendererRect *screen = renderer_tile_rects + root_tile;
+    if (scrub_line < screen->top || scrub_line > screen->bottom)
+        scrub_line = screen->top;
+    area->x1 = screen->left;
+    area->x2 = screen->right;
+    area->y1 = scrub_line;
+    area->y2 = (screen->bottom - scrub_line < RENDERER_SCRUB_LINES)
+               ? screen->bottom
+               : scrub_line + RENDERER_SCRUB_LINES - 1;
+    scrub_line = area->y2 + 1;
+    return true;
+#else
+    return false;
+#endif
 }
 
 void renderer_update_display(uint8_t *queue_data, uint16_t queue_max_length,
@@ -282,20 +526,123 @@ void renderer_update_display(uint8_t *queue_data, uint16_t queue_max_length,
     *queue_length = 0;
     if (root_tile == RENDERER_NULL_HANDLE)
         return;
-    render_tile(&buffer, root_tile, queue_data, queue_max_length, queue_length);
-    if (*queue_length)
+
+    // start a new frame?
+    if (!renderer_frame_pending()) {
+        // nothing changed?
+        tRectangle scrub;
+        bool scrubbing = scrub_area(&scrub);
+        if (!renderer_tiles_dirty && !buffer.not_rendered_at_all && !scrubbing)
+            return;
+
+        // collect damage of all changed tiles
+        renderer_damage_reset(&damage);
+        collect_damage(&buffer);
+        if (scrubbing && !buffer.not_rendered_at_all)
+            renderer_damage_add(&damage, &scrub);
+
+        // the changes are in the damage list now
         update_tile_cache();
+        pending_area = 0;
+        if (!damage.count)
+            return;
+
+        statistics.frames++;
+        statistics.requested_areas += damage.requested_areas;
+        statistics.requested_pixels += damage.requested_pixels;
+        statistics.rendered_areas += damage.count;
+        statistics.rendered_pixels += renderer_damage_pixels(&damage);
+#ifdef TRACE_RENDERER_DETAILS
+        TRACE("Frame: %d areas (%d requested), %d pixels (%d requested)",
+              damage.count, damage.requested_areas,
+              renderer_damage_pixels(&damage), damage.requested_pixels)
+#endif
+    }
+
+    // redraw coalesced areas
+    redraw_pending(queue_data, queue_max_length, queue_length);
+
+    statistics.queues++;
+    if (statistics.queue_peak < *queue_length)
+        statistics.queue_peak = *queue_length;
+}
+
+bool renderer_frame_pending() {
+    return pending_area < damage.count;
 }
 
+void renderer_get_statistics(tRendererStatistics *stats) {
+    *stats = statistics;
+}
 
-static void update_tile_cache() {
-    memcpy(&buffer.tile_cache, renderer_tiles, sizeof(tRendererTile) * renderer_tiles_count);
-    if (refresh_timer < TIME_GET) {
-        refresh_timer = TIME_GET + REFRESH_TIMER;
-        buffer.not_rendered_at_all = true;
+
+// brings the snapshot up to date, only tiles changed since the last frame are copied
+// (everything when the whole screen has been redrawn)
+static void snapshot_tiles() {
+    unsigned words = RENDERER_BITMAP_WORDS(renderer_tiles_count), word;
+    if (buffer.not_rendered_at_all) {
+        memcpy(buffer.rects, renderer_tile_rects, sizeof(tRendererRect) * renderer_tiles_count);
+        memcpy(buffer.appearance, renderer_tile_appearance, sizeof(tRendererAppearance) * renderer_tiles_count);
+        for (word = 0; word < words; word++) {
+            buffer.shown[word] = shown_tiles(word);
+            renderer_tile_dirty[word] = 0;
+        }
     } else {
-        buffer.not_rendered_at_all = false;
+        for (word = 0; word < words; word++) {
+            uint32_t dirty = renderer_tile_dirty[word];
+            if (!dirty)
+                continue;
+            buffer.shown[word] = shown_tiles(word);
+            while (dirty) {
+                tRendererTileHandle tile_handle = (word << 5) + __builtin_ctz(dirty);
+                dirty &= dirty - 1;
+                buffer.rects[tile_handle] = renderer_tile_rects[tile_handle];
+                buffer.appearance[tile_handle] = renderer_tile_appearance[tile_handle];
+            }
+            renderer_tile_dirty[word] = 0;
+        }
     }
+    renderer_tiles_dirty = false;
+}
+
+static void update_tile_cache() {
+    snapshot_tiles();
+    buffer.not_rendered_at_all = false;
+}
+
+static inline uint16_t vc_pack_color(tRendererColor color) {
+    return ((color.blue >> 4) & 0x0f)
+           | (((color.green >> 4) & 0x0f) << 4)
+           | (((color.red >> 4) & 0x0f) << 8)
+           | (((color.alpha >> 4) & 0x0f) << 12);
+}
+
+// rectangle expressible relatively to the previous command?
+static inline bool vc_relative(tRendererPosition left,
+                               tRendererPosition top,
+                               tRendererPosition width,
+                               tRendererPosition height) {
+    int dx = (int) left - (int) encoder.left;
+    int dy = (int) top - (int) encoder.top;
+    return encoder.valid
+           && dx >= -128 && dx <= 127
+           && dy >= -128 && dy <= 127
+           && width >= 1 && width <= 256
+           && height >= 1 && height <= 256;
+}
+
+static void vc_cmd_relative(tRendererPosition left,
+                            tRendererPosition top,
+                            tRendererPosition width,
+                            tRendererPosition height,
+                            uint8_t *buffer,
+                            uint16_t *length) {
+    buffer[(*length)++] = (left - encoder.left) & 0xff;
+    buffer[(*length)++] = (top - encoder.top) & 0xff;
+    buffer[(*length)++] = width - 1;
+    buffer[(*length)++] = height - 1;
+    encoder.left = left;
+    encoder.top = top;
 }
 
 static void vc_cmd_common(tRendererPosition left,
@@ -303,7 +650,6 @@ static void vc_cmd_common(tRendererPosition left,
                           tRendererPosition width,
                           tRendererPosition height,
                           uint8_t *buffer,
-                          uint16_t max_length,
                           uint16_t *length) {
     buffer[(*length)++] = top & 0xff;
     buffer[(*length)++] = left & 0xff;
@@ -314,22 +660,19 @@ static void vc_cmd_common(tRendererPosition left,
             | (((top >> 8) & 3) << 0)
             | ((((left + width - 1) >> 8) & 3) << 6)
             | ((((top + height - 1) >> 8) & 3) << 4);
+    encoder.valid = true;
+    encoder.left = left;
+    encoder.top = top;
 }
 
-static void vc_cmd_color(tRendererColor color,
+static void vc_cmd_color(uint16_t color,
                          uint8_t *buffer,
-                         uint16_t max_length,
                          uint16_t *length) {
-    uint8_t red = ((color.red) >> 4) & 0x0f;
-    uint8_t green = ((color.green) >> 4) & 0x0f;
-    uint8_t blue = ((color.blue) >> 4) & 0x0f;
-    uint8_t alpha = ((color.alpha) >> 4) & 0x0f;
-
-    buffer[(*length)++] = blue | (green << 4);
-    buffer[(*length)++] = red | (alpha << 4);
+    buffer[(*length)++] = color & 0xff;
+    buffer[(*length)++] = color >> 8;
 }
 
-void vc_cmd_rect_color(tRendererPosition left,
+bool vc_cmd_rect_color(tRendererPosition left,
                        tRendererPosition top,
                        tRendererPosition width,
                        tRendererPosition height,
@@ -337,16 +680,40 @@ void vc_cmd_rect_color(tRendererPosition left,
                        uint8_t *buffer,
                        uint16_t max_length,
                        uint16_t *length) {
+    if (*length == 0)
+        encoder.valid = false;
+    uint16_t packed_color = vc_pack_color(color);
+
+    // same color as previous?
+    if (!encoder.textured && encoder.color == packed_color && vc_relative(left, top, width, height)) {
+        if (*length + VC_CMD_RECT_SAME_LENGTH > max_length)
+            return false;
+        buffer[(*length)++] = VC_OP_RECT_SAME;
+        vc_cmd_relative(left, top, width, height, buffer, length);
+        encoder.glyphs_count = 0;
+        return true;
+    }
+
+    if (*length + VC_CMD_RECT_COLOR_LENGTH > max_length)
+        return false;
+
+    buffer[(*length)++] = VC_OP_RECT;
+
     vc_cmd_common(left, top, width, height,
-                  buffer, max_length, length);
+                  buffer, length);
 
     buffer[(*length)++] = 0x00;
 
-    vc_cmd_color(color,
-                 buffer, max_length, length);
+    vc_cmd_color(packed_color,
+                 buffer, length);
+
+    encoder.textured = false;
+    encoder.color = packed_color;
+    encoder.glyphs_count = 0;
+    return true;
 }
 
-static void vc_cmd_rect_texture(tRendererPosition left,
+static bool vc_cmd_rect_texture(tRendererPosition left,
                                 tRendererPosition top,
                                 tRendererPosition width,
                                 tRendererPosition height,
@@ -357,22 +724,85 @@ static void vc_cmd_rect_texture(tRendererPosition left,
                                 uint8_t *buffer,
                                 uint16_t max_length,
                                 uint16_t *length) {
+    if (*length == 0)
+        encoder.valid = false;
+    uint16_t packed_color = vc_pack_color(color);
+
+    uint32_t base = texture->base + texture_offset;
+    base += texture_top * texture->stripe_length;
+    base += texture_left;
+
+    // same stripe & color as previous?
+    if (encoder.textured
+        && encoder.stripe_length == texture->stripe_length
+        && encoder.color == packed_color
+        && vc_relative(left, top, width, height)) {
+        if (encoder.glyphs_count == 1) {
+            // single glyph -> glyph batch
+            if (*length + 1 + VC_CMD_GLYPH_BODY_LENGTH > max_length)
+                return false;
+            uint8_t *glyph = buffer + encoder.glyphs_position;
+            unsigned i;
+            for (i = VC_CMD_GLYPH_BODY_LENGTH; i > 0; i--)
+                glyph[i + 1] = glyph[i];
+            glyph[0] = VC_OP_GLYPHS;
+            glyph[1] = 1;
+            (*length)++;
+            encoder.glyphs_count++;
+        } else if (encoder.glyphs_count > 1 && encoder.glyphs_count < 256) {
+            // append to glyph batch
+            if (*length + VC_CMD_GLYPH_BODY_LENGTH > max_length)
+                return false;
+            buffer[encoder.glyphs_position + 1] = encoder.glyphs_count++;
+        } else {
+            // single glyph
+            if (*length + VC_CMD_GLYPH_LENGTH > max_length)
+                return false;
+            encoder.glyphs_position = *length;
+            encoder.glyphs_count = 1;
+            buffer[(*length)++] = VC_OP_GLYPH;
+        }
+        vc_cmd_relative(left, top, width, height, buffer, length);
+        buffer[(*length)++] = base & 0x0ff;
+        buffer[(*length)++] = (base >> 8) & 0x0ff;
+        buffer[(*length)++] = (base >> 16) & 0x0ff;
+        return true;
+    }
+
+    if (*length + VC_CMD_RECT_TEXTURE_LENGTH > max_length)
+        return false;
+
+    buffer[(*length)++] = VC_OP_RECT;
+
     vc_cmd_common(left, top, width, height,
-                  buffer, max_length, length);
+                  buffer, length);
 
 
     buffer[(*length)++] = 0x01 | ((texture->stripe_length & 0x0300) >> 2);
     buffer[(*length)++] = texture->stripe_length & 0xff;
 
-    uint32_t base = texture->base;
-    base += texture_top * texture->stripe_length;
-    base += texture_left;
     buffer[(*length)++] = base & 0x0ff;
     buffer[(*length)++] = (base >> 8) & 0x0ff;
     buffer[(*length)++] = (base >> 16) & 0x0ff;
 
-    vc_cmd_color(color,
-                 buffer, max_length, length);
+    vc_cmd_color(packed_color,
+                 buffer, length);
+
+    encoder.textured = true;
+    encoder.stripe_length = texture->stripe_length;
+    encoder.color = packed_color;
+    encoder.glyphs_count = 0;
+    return true;
+}
+
+static void mark_screen_tiles(tRendererTileHandle tile_handle) {
+    if (tile_handle >= renderer_tiles_count || renderer_bit_get(screen_tiles, tile_handle))
+        return;
+    renderer_bit_set(screen_tiles, tile_handle, true);
+    tRendererTile *tile = renderer_tiles + tile_handle;
+    unsigned i;
+    for (i = 0; i < tile->children_count && tile->children_list_index + i < renderer_child_index_count; i++)
+        mark_screen_tiles(renderer_child_index[tile->children_list_index + i]);
 }
 
 void renderer_show_screen(tRendererScreenHandle screen_handle) {
@@ -382,7 +812,7 @@ void renderer_show_screen(tRendererScreenHandle screen_handle) {
     }
 
     // screen definition
-    tRendererScreen *screen = renderer_screens + screen_handle;
+    const tRendererScreen *screen = renderer_screens + screen_handle;
 
     if (screen->root_tile >= renderer_tiles_count) {
         TRACE("RendererShowScreen: Invalid root tile handle %d", screen->root_tile)
@@ -392,18 +822,32 @@ void renderer_show_screen(tRendererScreenHandle screen_handle) {
     // graphics changes?
     if (graphics_handle != screen->graphics) {
         graphics_handle = screen->graphics;
-        vc_set_render_mode(renderer_graphics + graphics_handle);
+        // packed alpha textures, two pixels per byte
+        texture_offset = vc_set_render_mode(renderer_graphics + graphics_handle) << 1;
+        // textures moved -> redraw everything
+        buffer.not_rendered_at_all = true;
     }
 
     if (screen->root_tile == root_tile)
         return;
     root_tile = screen->root_tile;
+    memset(screen_tiles, 0, sizeof(screen_tiles));
+    mark_screen_tiles(root_tile);
+    renderer_index_build(root_tile);
     buffer.not_rendered_at_all = true;
 }
 
 void renderer_show_video(tRendererVideoHandle video_handle,
                          rRendererVideoCallback callback,
                          const void *callback_arg) {
+    if (video_handle >= renderer_videos_count) {
+        TRACE("RendererShowVideo: Invalid video handle %d", video_handle)
+        return;
+    }
+
+    // frames overwrite the textures -> next screen uploads them again
+    graphics_handle = RENDERER_NULL_HANDLE;
+
     // configure video core
     vc_set_playback_mode(renderer_videos + video_handle,
                          callback, callback_arg);
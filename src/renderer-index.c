@@ -0,0 +1,199 @@
+#include "renderer-index.h"
+#include "trace.h"
+
+// The index is a separable uniform grid: each grid column (row) holds a bitmap
+// of tiles whose horizontal (vertical) extent touches the column (row). A tile
+// overlaps a query rectangle iff it is present in both the OR of the columns
+// and the OR of the rows covered by the rectangle. Bits are ordered by the
+// rendering order, so scanning the result bitmap yields tiles in z-order.
+
+// 10-bit coordinates
+#define INDEX_CELLS                     (1024 >> RENDERER_INDEX_CELL_SHIFT)
+#define INDEX_WORDS                     RENDERER_BITMAP_WORDS(RENDERER_MAX_TILES)
+#define INDEX_NOT_INDEXED               0xffff
+
+typedef struct tCellSpan {
+    uint8_t x1;
+    uint8_t x2;
+    uint8_t y1;
+    uint8_t y2;
+} tCellSpan;
+
+// tiles of the current screen in rendering order
+static tRendererTileHandle order[RENDERER_MAX_TILES];
+static unsigned order_count;
+static unsigned word_count;
+
+// rendering order of each tile (by tile handle)
+static uint16_t rank[RENDERER_MAX_TILES];
+
+// indexed cell span (by rendering order)
+static tCellSpan span[RENDERER_MAX_TILES];
+
+// grid
+static uint32_t columns[INDEX_CELLS][INDEX_WORDS];
+static uint32_t rows[INDEX_CELLS][INDEX_WORDS];
+
+static bool valid;
+
+static inline uint8_t cell(tRendererPosition position) {
+    unsigned c = position >> RENDERER_INDEX_CELL_SHIFT;
+    return (c >= INDEX_CELLS) ? (INDEX_CELLS - 1) : c;
+}
+
+static inline void compute_span(const tRendererRect *rect, tCellSpan *s) {
+    // empty tile?
+    if (rect->right < rect->left || rect->bottom < rect->top) {
+        s->x1 = 1;
+        s->x2 = 0;
+        s->y1 = 1;
+        s->y2 = 0;
+        return;
+    }
+    s->x1 = cell(rect->left);
+    s->x2 = cell(rect->right);
+    s->y1 = cell(rect->top);
+    s->y2 = cell(rect->bottom);
+}
+
+static void mark_span(const tCellSpan *s, unsigned tile_rank, bool set) {
+    unsigned word = tile_rank >> 5;
+    uint32_t bit = ((uint32_t) 1) << (tile_rank & 31);
+    unsigned i;
+    for (i = s->x1; i <= s->x2 && s->x1 <= s->x2; i++) {
+        if (set)
+            columns[i][word] |= bit;
+        else
+            columns[i][word] &= ~bit;
+    }
+    for (i = s->y1; i <= s->y2 && s->y1 <= s->y2; i++) {
+        if (set)
+            rows[i][word] |= bit;
+        else
+            rows[i][word] &= ~bit;
+    }
+}
+
+static bool collect_tiles(tRendererTileHandle tile_handle) {
+    if (tile_handle >= renderer_tiles_count) {
+        TRACE("RendererIndex: Invalid tile handle %d", tile_handle)
+        return false;
+    }
+    if (rank[tile_handle] != INDEX_NOT_INDEXED) {
+        TRACE("RendererIndex: Tile %d referenced twice", tile_handle)
+        return false;
+    }
+    rank[tile_handle] = order_count;
+    order[order_count++] = tile_handle;
+
+    const tRendererTile *tile = renderer_tiles + tile_handle;
+    if (tile->children_list_index + tile->children_count > renderer_child_index_count) {
+        TRACE("RendererIndex: Inconsistent tile children index for tile %d", tile_handle)
+        return false;
+    }
+    unsigned i;
+    for (i = 0; i < tile->children_count; i++) {
+        if (!collect_tiles(renderer_child_index[tile->children_list_index + i]))
+            return false;
+    }
+    return true;
+}
+
+bool renderer_index_build(tRendererTileHandle root) {
+    valid = false;
+    if (renderer_tiles_count > RENDERER_MAX_TILES) {
+        TRACE("RendererIndex: Too many tiles (%d), index disabled", renderer_tiles_count)
+        return false;
+    }
+
+    // compute rendering order
+    unsigned i;
+    for (i = 0; i < renderer_tiles_count; i++)
+        rank[i] = INDEX_NOT_INDEXED;
+    order_count = 0;
+    if (!collect_tiles(root))
+        return false;
+    word_count = RENDERER_BITMAP_WORDS(order_count);
+
+    // fill grid
+    for (i = 0; i < INDEX_CELLS; i++) {
+        unsigned j;
+        for (j = 0; j < INDEX_WORDS; j++) {
+            columns[i][j] = 0;
+            rows[i][j] = 0;
+        }
+    }
+    for (i = 0; i < order_count; i++) {
+        compute_span(renderer_tile_rects + order[i], span + i);
+        mark_span(span + i, i, true);
+    }
+
+    valid = true;
+    TRACE("RendererIndex: Indexed %d tiles", order_count)
+    return true;
+}
+
+bool renderer_index_valid() {
+    return valid;
+}
+
+void renderer_index_reset() {
+    valid = false;
+    order_count = 0;
+    word_count = 0;
+}
+
+void renderer_index_update(tRendererTileHandle tile_handle) {
+    if (!valid || tile_handle >= renderer_tiles_count)
+        return;
+    unsigned tile_rank = rank[tile_handle];
+    if (tile_rank == INDEX_NOT_INDEXED)
+        return;
+
+    tCellSpan s;
+    compute_span(renderer_tile_rects + tile_handle, &s);
+    tCellSpan *current = span + tile_rank;
+    if (s.x1 == current->x1 && s.x2 == current->x2 && s.y1 == current->y1 && s.y2 == current->y2)
+        return;
+
+    mark_span(current, tile_rank, false);
+    *current = s;
+    mark_span(current, tile_rank, true);
+}
+
+unsigned renderer_index_query(tRendererPosition x1, tRendererPosition y1,
+                              tRendererPosition x2, tRendererPosition y2,
+                              tRendererTileHandle *tiles) {
+    if (!valid || x2 < x1 || y2 < y1)
+        return 0;
+
+    unsigned cx1 = cell(x1), cx2 = cell(x2);
+    unsigned cy1 = cell(y1), cy2 = cell(y2);
+    unsigned count = 0;
+    unsigned word;
+    for (word = 0; word < word_count; word++) {
+        // candidates at grid precision
+        uint32_t mask_x = 0, mask_y = 0;
+        unsigned i;
+        for (i = cx1; i <= cx2; i++)
+            mask_x |= columns[i][word];
+        for (i = cy1; i <= cy2; i++)
+            mask_y |= rows[i][word];
+        uint32_t mask = mask_x & mask_y;
+
+        // exact test
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            mask &= mask - 1;
+            tRendererTileHandle tile_handle = order[(word << 5) + bit];
+            const tRendererRect *rect = renderer_tile_rects + tile_handle;
+            if (rect->right < x1
+                || rect->left > x2
+                || rect->bottom < y1
+                || rect->top > y2)
+                continue;
+            tiles[count++] = tile_handle;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,30 @@
+#ifndef RENDERER_RENDERER_INDEX_H
+#define RENDERER_RENDERER_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "renderer-definition.h"
+
+// grid cell size (64 pixels)
+#ifndef RENDERER_INDEX_CELL_SHIFT
+#define RENDERER_INDEX_CELL_SHIFT       6
+#endif
+
+// builds the spatial index for the tile tree starting at root tile
+bool renderer_index_build(tRendererTileHandle root);
+
+// index available (built & scene fits into index limits)
+bool renderer_index_valid();
+
+// drops the index (tile tables replaced)
+void renderer_index_reset();
+
+// re-indexes the tile after its position has been changed
+void renderer_index_update(tRendererTileHandle tile_handle);
+
+// finds all tiles overlapping the area, tiles are returned in rendering (z) order
+unsigned renderer_index_query(tRendererPosition x1, tRendererPosition y1,
+                              tRendererPosition x2, tRendererPosition y2,
+                              tRendererTileHandle *tiles);
+
+#endif //RENDERER_RENDERER_INDEX_H
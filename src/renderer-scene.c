@@ -3,11 +3,16 @@
 //
 #include "renderer.h"
 #include "renderer-definition.h"
+#include "renderer-scene.h"
+#include "renderer-index.h"
 #include "trace.h"
 
 
 static inline tRendererColor map_color(tRendererColorHandle handle);
 
+uint32_t renderer_tile_dirty[RENDERER_BITMAP_WORDS(RENDERER_MAX_TILES)];
+bool renderer_tiles_dirty;
+
 
 static void propagate_visibility(tRendererTileHandle tile_handle, bool visible) {
     if (tile_handle >= renderer_tiles_count) {
@@ -26,8 +31,9 @@ static void propagate_visibility(tRendererTileHandle tile_handle, bool visible)
             TRACE("PropagateVisibility: Invalid child tile handle %d", *children)
             continue;
         }
-        renderer_tiles[*children].parent_visible = visible;
-        propagate_visibility(*children, visible && renderer_tiles[*children].tile_visible);
+        renderer_bit_set(renderer_tile_parent_visible, *children, visible);
+        renderer_mark_dirty(*children);
+        propagate_visibility(*children, visible && renderer_bit_get(renderer_tile_visible, *children));
     }
 }
 
@@ -36,10 +42,11 @@ void renderer_set_visibility(tRendererTileHandle tile, bool visible) {
         TRACE("RendererSetVisibility: Invalid tile handle %d", tile)
         return;
     }
-    if (renderer_tiles[tile].tile_visible == visible)
+    if (renderer_bit_get(renderer_tile_visible, tile) == visible)
         return;
-    renderer_tiles[tile].tile_visible = visible;
-    propagate_visibility(tile, visible && renderer_tiles[tile].parent_visible);
+    renderer_bit_set(renderer_tile_visible, tile, visible);
+    renderer_mark_dirty(tile);
+    propagate_visibility(tile, visible && renderer_bit_get(renderer_tile_parent_visible, tile));
 }
 
 void renderer_set_position(tRendererTileHandle tile_handle,
@@ -49,10 +56,13 @@ void renderer_set_position(tRendererTileHandle tile_handle,
         return;
     }
     register tRendererTile *tile = renderer_tiles + tile_handle;
-    tile->position_left = left;
-    tile->position_right = left + tile->position_width - 1;
-    tile->position_top = top;
-    tile->position_bottom = top + tile->position_height - 1;
+    register tRendererRect *rect = renderer_tile_rects + tile_handle;
+    rect->left = left;
+    rect->right = left + tile->position_width - 1;
+    rect->top = top;
+    rect->bottom = top + tile->position_height - 1;
+    renderer_index_update(tile_handle);
+    renderer_mark_dirty(tile_handle);
 }
 
 void renderer_set_color(tRendererTileHandle tile, tRendererColorHandle color) {
@@ -66,6 +76,37 @@ void renderer_set_color(tRendererTileHandle tile, tRendererColorHandle color) {
     }
     renderer_tiles[tile].color_handle = color;
     renderer_tiles[tile].color = map_color(color);
+    renderer_tile_appearance[tile] = renderer_appearance_pack(renderer_tiles + tile);
+    renderer_mark_dirty(tile);
+}
+
+// glyph of the code point (NULL if the font has none)
+static const tRendererFontGlyph *find_glyph(uint16_t font_handle, uint32_t code_point) {
+    // fonts not indexed yet
+    if (!renderer_font_index)
+        return NULL;
+
+    // printable ASCII -> direct table
+    uint32_t ascii = code_point - RENDERER_GLYPH_ASCII_FIRST;
+    if (ascii < RENDERER_GLYPH_ASCII_COUNT) {
+        uint16_t glyph = renderer_font_index[font_handle].ascii[ascii];
+        return (glyph == RENDERER_NULL_HANDLE) ? NULL : renderer_font_glyphs + glyph;
+    }
+
+    // others -> binary search
+    const tRendererFont *font = renderer_fonts + font_handle;
+    const uint16_t *order = renderer_glyph_order + font->first_glyph;
+    unsigned low = 0, high = font->glyph_count;
+    while (low < high) {
+        unsigned middle = (low + high) >> 1;
+        if (renderer_font_glyphs[order[middle]].code_point < code_point)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < font->glyph_count && renderer_font_glyphs[order[low]].code_point == code_point)
+        return renderer_font_glyphs + order[low];
+    return NULL;
 }
 
 static const uint32_t offsetsFromUTF8[6] = {
@@ -88,6 +129,69 @@ static uint32_t utf_nextchar(const char *s, unsigned *i) {
     return ch;
 }
 
+// next character of the text: glyph (NULL for space & unknown code point) & pen advance
+static const tRendererFontGlyph *next_character(uint16_t font_handle, const char **text,
+                                                tRendererPosition *advance) {
+    // extract code point
+    unsigned i = 0;
+    uint32_t code_point = utf_nextchar(*text, &i);
+    *text += i;
+
+    // space or unknown code point -> show space
+    const tRendererFontGlyph *glyph = (code_point == ' ') ? NULL : find_glyph(font_handle, code_point);
+    *advance = glyph ? glyph->advance_x : renderer_fonts[font_handle].space_width;
+    return glyph;
+}
+
+// same glyph at the same place is not touched (not redrawn)
+static void place_character(tRendererTileHandle tile_handle, const tRendererFontGlyph *glyph,
+                            tRendererPosition left, tRendererPosition top) {
+    tRendererTile *tile = renderer_tiles + tile_handle;
+    tRendererRect *rect = renderer_tile_rects + tile_handle;
+    uint16_t glyph_handle = glyph - renderer_font_glyphs;
+    if (tile->glyph == glyph_handle && rect->left == left && rect->top == top
+        && renderer_bit_get(renderer_tile_visible, tile_handle))
+        return;
+
+    // set character tile coordinates & texture
+    renderer_bit_set(renderer_tile_visible, tile_handle, true);
+    tile->glyph = glyph_handle;
+    rect->top = top;
+    rect->left = left;
+    tile->position_width = glyph->width;
+    tile->position_height = glyph->height;
+    rect->right = rect->left + tile->position_width - 1;
+    rect->bottom = rect->top + tile->position_height - 1;
+    tile->texture.base = glyph->texture.base;
+    tile->texture.stripe_length = glyph->texture.stripe_length;
+    tile->texture.packed_alpha = glyph->texture.packed_alpha;
+    renderer_tile_appearance[tile_handle] = renderer_appearance_pack(tile);
+    renderer_index_update(tile_handle);
+    renderer_mark_dirty(tile_handle);
+}
+
+// X position of the first character
+static inline tRendererPosition text_origin(const tRendererText *text_definition, tRendererPosition width) {
+    tRendererPosition x = text_definition->position_x;
+    if (text_definition->alignment_h == TEXT_RIGHT)
+        x -= width;
+    if (text_definition->alignment_h == TEXT_CENTER)
+        x -= width / 2;
+    return x;
+}
+
+// unused character tiles of the text are hidden
+static void hide_characters(const tRendererText *text_definition, unsigned character_index) {
+    for (; character_index < text_definition->tile_count; character_index++) {
+        tRendererTileHandle character_tile = text_definition->tile + character_index;
+        if (!renderer_bit_get(renderer_tile_visible, character_tile))
+            continue;
+        renderer_bit_set(renderer_tile_visible, character_tile, false);
+        renderer_tiles[character_tile].glyph = RENDERER_NULL_HANDLE;
+        renderer_mark_dirty(character_tile);
+    }
+}
+
 void renderer_set_text(tRendererTileHandle tile_handle, const char *text) {
     if (tile_handle >= renderer_texts_count) {
         TRACE("renderer_set_text: Invalid text handle %d", tile_handle);
@@ -96,70 +200,100 @@ void renderer_set_text(tRendererTileHandle tile_handle, const char *text) {
 
     // find text definition
     tRendererText *text_definition = renderer_texts + tile_handle;
-    tRendererFont *font = renderer_fonts + text_definition->font;
+    const char *characters;
+    unsigned character_index;
+    tRendererPosition advance;
 
-    // layout all characters
-    unsigned character_index = 0;
+    // text width (needed by the alignment only)
     tRendererPosition x = 0;
-    while (*text && character_index < text_definition->tile_count) {
-        // extract code point
-        unsigned i = 0;
-        uint32_t code_point = utf_nextchar(text, &i);
-        text += i;
-
-        // space?
-        if (code_point == ' ') {
-            x += font->space_width;
-            continue;
+    if (text_definition->alignment_h != TEXT_LEFT) {
+        for (characters = text, character_index = 0;
+             *characters && character_index < text_definition->tile_count;) {
+            if (next_character(text_definition->font, &characters, &advance))
+                character_index++;
+            x += advance;
         }
+    }
 
-        // find glyph
-        tRendererFontGlyph *glyph;
-        for (glyph = renderer_font_glyphs + font->first_glyph, i = font->glyph_count; i > 0; i--, glyph++) {
-            if (glyph->code_point == code_point)
-                break;
-        }
-        if (i == 0) {
-            // unknown code point -> show space
-            x += font->space_width;
-            continue;
+    // layout all characters
+    for (characters = text, character_index = 0, x = text_origin(text_definition, x);
+         *characters && character_index < text_definition->tile_count;) {
+        const tRendererFontGlyph *glyph = next_character(text_definition->font, &characters, &advance);
+        if (glyph) {
+            place_character(text_definition->tile + character_index, glyph,
+                            x + glyph->offset_x, text_definition->position_y + glyph->offset_y);
+            character_index++;
         }
+        x += advance;
+    }
 
-        // set character tile coordinates & texture
-        tRendererTile *tile = renderer_tiles + text_definition->tile + character_index;
-        tile->tile_visible = true;
-        tile->position_top = text_definition->position_y + glyph->offset_y;
-        tile->position_left = x + glyph->offset_x;
-        tile->position_width = glyph->width;
-        tile->position_height = glyph->height;
-        tile->position_right = tile->position_left + tile->position_width - 1;
-        tile->position_bottom = tile->position_top + tile->position_height - 1;
-        tile->texture.base = glyph->texture.base;
-        tile->texture.stripe_length = glyph->texture.stripe_length;
-        tile->texture.packed_alpha = glyph->texture.packed_alpha;
+    hide_characters(text_definition, character_index);
+}
 
-        x += glyph->advance_x;
+// glyph of the ASCII character (NULL for space & unknown character)
+static inline const tRendererFontGlyph *ascii_glyph(uint16_t font_handle, char character) {
+    unsigned ascii = (uint8_t) character - RENDERER_GLYPH_ASCII_FIRST;
+    if (character == ' ' || ascii >= RENDERER_GLYPH_ASCII_COUNT || !renderer_font_index)
+        return NULL;
+    uint16_t glyph = renderer_font_index[font_handle].ascii[ascii];
+    return (glyph == RENDERER_NULL_HANDLE) ? NULL : renderer_font_glyphs + glyph;
+}
 
-        character_index++;
+void renderer_set_number(tRendererTileHandle tile_handle, int32_t value, uint16_t format) {
+    if (tile_handle >= renderer_texts_count) {
+        TRACE("renderer_set_number: Invalid text handle %d", tile_handle)
+        return;
     }
+    tRendererText *text_definition = renderer_texts + tile_handle;
+    const tRendererFont *font = renderer_fonts + text_definition->font;
+
+    // format from the least significant digit
+    char buffer[RENDERER_NUMBER_LENGTH];
+    char *end = buffer + RENDERER_NUMBER_LENGTH, *characters = end;
+    unsigned decimals = RENDERER_NUMBER_GET_DECIMALS(format);
+    unsigned pad = RENDERER_NUMBER_GET_PAD(format);
+    uint32_t magnitude = (value < 0) ? -(uint32_t) value : (uint32_t) value;
+    unsigned digits = 0;
+    do {
+        *--characters = '0' + magnitude % 10;
+        magnitude /= 10;
+        if (++digits == decimals)
+            *--characters = '.';
+    } while (magnitude || digits <= decimals || digits < pad);
+    if (value < 0)
+        *--characters = '-';
+    else if (format & RENDERER_NUMBER_PLUS)
+        *--characters = '+';
 
-    while (character_index < text_definition->tile_count) {
-        tRendererTile *tile = renderer_tiles + text_definition->tile + character_index++;
-        tile->tile_visible = false;
+    // text width (needed by the alignment only)
+    const char *character;
+    unsigned character_index;
+    tRendererPosition x = 0;
+    if (text_definition->alignment_h != TEXT_LEFT) {
+        for (character = characters, character_index = 0;
+             character < end && character_index < text_definition->tile_count; character++) {
+            const tRendererFontGlyph *glyph = ascii_glyph(text_definition->font, *character);
+            if (glyph)
+                character_index++;
+            x += glyph ? glyph->advance_x : font->space_width;
+        }
     }
 
-    // update X position
-    tRendererPosition deltaX = text_definition->position_x;
-    if (text_definition->alignment_h == TEXT_RIGHT)
-        deltaX -= x;
-    if (text_definition->alignment_h == TEXT_CENTER)
-        deltaX -= x / 2;
-    for (character_index = 0; character_index < text_definition->tile_count; character_index++) {
-        tRendererTile *tile = renderer_tiles + text_definition->tile + character_index;
-        tile->position_left += deltaX;
-        tile->position_right += deltaX;
+    // layout all characters
+    for (character = characters, character_index = 0, x = text_origin(text_definition, x);
+         character < end && character_index < text_definition->tile_count; character++) {
+        const tRendererFontGlyph *glyph = ascii_glyph(text_definition->font, *character);
+        if (glyph) {
+            place_character(text_definition->tile + character_index, glyph,
+                            x + glyph->offset_x, text_definition->position_y + glyph->offset_y);
+            character_index++;
+            x += glyph->advance_x;
+        } else {
+            x += font->space_width;
+        }
     }
 
+    hide_characters(text_definition, character_index);
 }
 
 static const tRendererColor default_color = {.red=0, .green=0, .blue=0, .alpha=255};
@@ -0,0 +1,27 @@
+#include <stdbool.h>
+#include "crc32.h"
+
+#define CRC32_POLYNOMIAL                0xEDB88320
+
+static uint32_t crc32_table[256];
+static bool crc32_table_ready;
+
+static void crc32_init() {
+    unsigned i, j;
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : (crc >> 1);
+        crc32_table[i] = crc;
+    }
+    crc32_table_ready = true;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t length) {
+    if (!crc32_table_ready)
+        crc32_init();
+    crc = ~crc;
+    while (length--)
+        crc = crc32_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
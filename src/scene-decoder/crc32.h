@@ -0,0 +1,10 @@
+#ifndef RENDERER_CRC32_H
+#define RENDERER_CRC32_H
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3), crc32_update(0, data, length) for the first block,
+// then pass the previous result to continue
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t length);
+
+#endif //RENDERER_CRC32_H
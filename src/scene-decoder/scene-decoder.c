@@ -3,131 +3,231 @@
 //
 #include <stdbool.h>
 #include "scene-decoder.h"
+#include "scene-format.h"
 #include "renderer-definition.h"
+#include "renderer.h"
 #include "spi-flash.h"
 #include "system-config.h"
 #include "trace.h"
 #include "memcpy.h"
+#include "crc32.h"
 
 static bool use_default;
 
-#define BUFFER_LENGTH                   256
-static uint8_t input_buffer[BUFFER_LENGTH];
+// flash burst length (tables longer than the buffer are read directly)
+#define BUFFER_LENGTH                   1024
+static uint8_t input_buffer[BUFFER_LENGTH] __attribute__((aligned(4)));
 static uint32_t input_buffer_start;
 static uint32_t input_position;
 static uint32_t input_data_length;
-
+static uint32_t input_magic;
+
+// incremental decoding
+#define RECORDS_PER_STEP                32
+
+typedef bool (*rDecodeSection)(bool custom);
+
+typedef struct tDecodeStep {
+    rDecodeSection decode;
+    const char *error;
+} tDecodeStep;
+
+static eSceneDecoderStatus decoder_status = SCENE_DECODER_IDLE;
+static bool decoder_custom;
+static const tDecodeStep *decoder_steps;
+static unsigned decoder_steps_count;
+// steps needed to show a screen (tiles, tree, screens & texture bundles)
+static unsigned decoder_screen_steps;
+static unsigned decoder_step;
+// next record of the section (multi-step sections)
+static unsigned decoder_record;
+static bool decoder_section_pending;
+// CRC of the section records read so far
+static uint32_t decoder_crc;
+// texts decoded, published when the decoding is finished (the layout needs
+// the validated fonts & the glyph lookup)
+static uint16_t texts_count;
+
+// direct image header
+static tSceneHeader direct_header;
+// direct image tables used in place (addressable & aligned image)
+static bool direct_in_place;
+
+// scene memory (arena for the decoded tables), the built-in one is used
+// unless a region is set by scene_decoder_set_memory()
+#ifndef SCENE_MEMORY_KB
 #define SCENE_MEMORY_KB                 16
+#endif
 #define SCENE_MEMORY                    ((SCENE_MEMORY_KB)*1024)
-static uint8_t memory[SCENE_MEMORY];
-static unsigned memory_size;
-
-uint16_t *renderer_colors;
+static uint8_t scene_memory[SCENE_MEMORY] __attribute__((aligned(8)));
+static uint8_t *memory = scene_memory;
+static uint32_t memory_capacity = SCENE_MEMORY;
+static uint32_t memory_size;
+// memory needed by the scene (known before decoding for direct images)
+static uint32_t memory_required;
+// memory used by each section
+static uint32_t memory_usage[SCENE_SECTION_COUNT];
+_Static_assert(SCENE_DECODER_SECTIONS == SCENE_SECTION_COUNT, "section count mismatch");
+
+const uint16_t *renderer_colors;
 uint16_t renderer_colors_simple_count;
 tRendererText *renderer_texts;
 uint16_t renderer_texts_count;
 tRendererTile *renderer_tiles;
 uint16_t renderer_tiles_count;
-tRendererTileHandle *renderer_child_index;
+tRendererRect *renderer_tile_rects;
+uint32_t *renderer_tile_visible;
+uint32_t *renderer_tile_parent_visible;
+tRendererAppearance *renderer_tile_appearance;
+const tRendererTileHandle *renderer_child_index;
 uint16_t renderer_child_index_count;
-tRendererScreen *renderer_screens;
+const tRendererScreen *renderer_screens;
 uint16_t renderer_screen_count;
 tRendererVideoDescriptor *renderer_videos;
 uint16_t renderer_videos_count;
-tRendererScreenGraphics *renderer_graphics;
+const tRendererScreenGraphics *renderer_graphics;
 uint16_t renderer_graphics_count;
-tRendererFontGlyph *renderer_font_glyphs;
+const uint32_t *renderer_graphics_pages;
+uint16_t renderer_graphics_pages_count;
+const tRendererFontGlyph *renderer_font_glyphs;
 uint16_t renderer_font_glyphs_count;
-tRendererFont *renderer_fonts;
+const tRendererFont *renderer_fonts;
 uint16_t renderer_fonts_count;
+const tRendererFontIndex *renderer_font_index;
+const uint16_t *renderer_glyph_order;
+
+static inline void input_read(bool custom, uint32_t address, uint8_t *data, uint32_t length) {
+    if (custom) {
+        spi_flash_read_sync(FLASH_BANK_SCENE, address, data, length);
+    } else {
+        // do not read behind the built-in image
+        if (address >= renderer_data_length)
+            return;
+        if (length > renderer_data_length - address)
+            length = renderer_data_length - address;
+        memcpy(data, renderer_data + address, length);
+    }
+}
+
+static inline void input_fill(bool custom) {
+    input_read(custom, input_buffer_start, input_buffer, BUFFER_LENGTH);
+}
+
+static inline uint16_t le16(const uint8_t *data) {
+    return ((uint16_t) data[0]) | (((uint16_t) data[1]) << 8);
+}
+
+static inline uint32_t le32(const uint8_t *data) {
+    return ((uint32_t) data[0]) | (((uint32_t) data[1]) << 8)
+           | (((uint32_t) data[2]) << 16) | (((uint32_t) data[3]) << 24);
+}
 
 static inline bool input_init(bool custom) {
     input_position = 8;
     input_buffer_start = 0;
-    if (custom) {
-        spi_flash_read_sync(FLASH_BANK_SCENE, 0, input_buffer, BUFFER_LENGTH);
-    } else {
-        memcpy(input_buffer, renderer_data, BUFFER_LENGTH);
-    }
-    if (((((uint32_t) input_buffer[0]) << 0) |
-         (((uint32_t) input_buffer[1]) << 8) |
-         (((uint32_t) input_buffer[2]) << 16) |
-         (((uint32_t) input_buffer[3]) << 24)) == 0xDEADBEEF) {
-        input_data_length =
-                (((uint32_t) input_buffer[4]) << 0) |
-                (((uint32_t) input_buffer[5]) << 8) |
-                (((uint32_t) input_buffer[6]) << 16) |
-                (((uint32_t) input_buffer[7]) << 24);
+    input_fill(custom);
+    input_magic = le32(input_buffer);
+    if (input_magic == SCENE_MAGIC_STREAM || input_magic == SCENE_MAGIC_DIRECT) {
+        input_data_length = le32(input_buffer + 4);
+        if (!custom && input_data_length > renderer_data_length)
+            return false;
     } else {
         return false;
     }
-    memory_size = 0;
     return true;
 }
 
-static inline void *__attribute((always_inline)) allocate(unsigned size, unsigned alignment) {
-    switch (alignment) {
-        case 2:
-            memory_size = (memory_size + 1) & ~1;
-            break;
-        case 4:
-            memory_size = (memory_size + 3) & ~3;
-            break;
-        default:
-            break;
+static inline uint32_t memory_align(uint32_t size, unsigned alignment) {
+    return (size + alignment - 1) & ~((uint32_t) alignment - 1);
+}
+
+static void memory_reset() {
+    memory_size = 0;
+    memory_required = 0;
+    memset(memory_usage, 0, sizeof(memory_usage));
+}
+
+// table of the section allocated from the scene memory (NULL if exhausted)
+static void *allocate(eSceneSection section, uint32_t size, unsigned alignment) {
+    uint32_t start = memory_align(memory_size, alignment);
+    if (start > memory_capacity || size > memory_capacity - start) {
+        TRACE("-- Scene memory exhausted (%d bytes needed, %d available)", start + size, memory_capacity)
+        return NULL;
+    }
+    memory_usage[section] += start + size - memory_size;
+    memory_size = start + size;
+    return memory + start;
+}
+
+static inline bool input_available(uint32_t length) {
+    return input_position <= input_data_length && length <= input_data_length - input_position;
+}
+
+// returns the record contiguous in the input buffer (NULL behind the end of data)
+static const uint8_t *input_get_record(bool custom, unsigned length) {
+    if (!input_available(length))
+        return NULL;
+    if (input_position < input_buffer_start || input_position + length > input_buffer_start + BUFFER_LENGTH) {
+        input_buffer_start = input_position;
+        input_fill(custom);
     }
-    void *ret = memory + memory_size;
-    memory_size += size;
-    return ret;
+    const uint8_t *record = input_buffer + (input_position - input_buffer_start);
+    input_position += length;
+    return record;
 }
 
-static inline bool input_get_byte(bool custom, uint8_t *buffer) {
-    if (input_position >= input_data_length)
+// reads the block, the part not in the input buffer is read directly
+static bool input_get_block(bool custom, uint8_t *data, uint32_t length) {
+    if (!input_available(length))
         return false;
-    if (input_position - input_buffer_start >= BUFFER_LENGTH) {
-        input_buffer_start += BUFFER_LENGTH;
-        if (custom)
-            spi_flash_read_sync(FLASH_BANK_SCENE, input_buffer_start, input_buffer, BUFFER_LENGTH);
-        else
-            memcpy(input_buffer, renderer_data + input_buffer_start, BUFFER_LENGTH);
+    if (input_position >= input_buffer_start && input_position < input_buffer_start + BUFFER_LENGTH) {
+        uint32_t offset = input_position - input_buffer_start;
+        uint32_t chunk = BUFFER_LENGTH - offset;
+        if (chunk > length)
+            chunk = length;
+        memcpy(data, input_buffer + offset, chunk);
+        input_position += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    if (length) {
+        input_read(custom, input_position, data, length);
+        input_position += length;
     }
-    *buffer = input_buffer[input_position - input_buffer_start];
-    input_position++;
     return true;
 }
 
-static inline bool input_get_word(bool custom, uint16_t *buffer) {
-    uint8_t b1;
-    uint8_t b2;
-    if (!input_get_byte(custom, &b1))
-        return false;
-    if (!input_get_byte(custom, &b2))
+// reads table of little-endian words
+static bool input_get_words(bool custom, uint16_t *words, unsigned count) {
+    if (!input_get_block(custom, (uint8_t *) words, ((uint32_t) count) * 2))
         return false;
-    *buffer = (((uint16_t) b2) << 8) | b1;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    unsigned i;
+    for (i = 0; i < count; i++)
+        words[i] = le16((const uint8_t *) (words + i));
+#endif
     return true;
 }
 
-static inline bool input_get_dword(bool custom, uint32_t *buffer) {
-    uint8_t b1;
-    uint8_t b2;
-    uint8_t b3;
-    uint8_t b4;
-    if (!input_get_byte(custom, &b1))
-        return false;
-    if (!input_get_byte(custom, &b2))
+static inline bool input_get_word(bool custom, uint16_t *word) {
+    const uint8_t *data = input_get_record(custom, 2);
+    if (!data)
         return false;
-    if (!input_get_byte(custom, &b3))
-        return false;
-    if (!input_get_byte(custom, &b4))
-        return false;
-    *buffer =
-            (((uint32_t) b1) << 0) |
-            (((uint32_t) b2) << 8) |
-            (((uint32_t) b3) << 16) |
-            (((uint32_t) b4) << 24);
+    *word = le16(data);
     return true;
 }
 
+// stream record lengths
+#define TEXTURE_RECORD_LENGTH           7
+#define TILE_RECORD_LENGTH              20
+#define SCREEN_RECORD_LENGTH            4
+#define GLYPH_RECORD_LENGTH             (12 + TEXTURE_RECORD_LENGTH)
+#define FONT_RECORD_LENGTH              6
+#define TEXT_RECORD_LENGTH              12
+#define BUNDLE_RECORD_LENGTH            8
+#define VIDEO_RECORD_LENGTH             10
+#define VIDEO_FRAME_RECORD_LENGTH       4
+
 static bool decode_color_table(bool custom) {
     TRACE("- Decoding color table")
     // number of colors
@@ -135,28 +235,24 @@ static bool decode_color_table(bool custom) {
         return false;
 
     // allocate memory
-    renderer_colors = allocate(2 * renderer_colors_simple_count, 2);
+    uint16_t *colors = allocate(SCENE_SECTION_COLORS, 2 * renderer_colors_simple_count, 2);
+    if (!colors)
+        return false;
+    renderer_colors = colors;
 
     // fill color table
-    unsigned i;
-    for (i = 0; i < renderer_colors_simple_count; i++) {
-        if (!input_get_word(custom, renderer_colors + i))
-            return false;
-    }
+    if (!input_get_words(custom, colors, renderer_colors_simple_count))
+        return false;
 
     TRACE("- Decoded %d colors", renderer_colors_simple_count)
 
     return true;
 }
 
-static bool decode_texture(bool custom, tRendererTexture *tex) {
-    if (!input_get_dword(custom, &tex->base))
-        return false;
-    if (!input_get_word(custom, &tex->stripe_length))
-        return false;
-    uint8_t texture_compression;
-    if (!input_get_byte(custom, &texture_compression))
-        return false;
+static bool decode_texture(const uint8_t *data, tRendererTexture *tex) {
+    tex->base = le32(data);
+    tex->stripe_length = le16(data + 4);
+    uint8_t texture_compression = data[6];
     if (texture_compression >= 2)
         return false;
     tex->packed_alpha = (texture_compression == 1);
@@ -166,64 +262,106 @@ static bool decode_texture(bool custom, tRendererTexture *tex) {
     return true;
 }
 
-static bool decode_tiles(bool custom) {
-    TRACE("- Decoding tiles")
-    // number of tiles
-    if (!input_get_word(custom, &renderer_tiles_count))
-        return false;
+// tile tables (all sizes are multiple of 4 bytes -> single block)
+static inline uint32_t tiles_memory_size(unsigned count) {
+    return count * (sizeof(tRendererTile) + sizeof(tRendererRect) + sizeof(tRendererAppearance))
+           + 2 * RENDERER_BITMAP_WORDS(count) * sizeof(uint32_t);
+}
 
-    // allocate memory
-    renderer_tiles = allocate(renderer_tiles_count * sizeof(tRendererTile), 4);
+static bool allocate_tiles() {
+    unsigned bitmap_words = RENDERER_BITMAP_WORDS(renderer_tiles_count);
+    uint8_t *block = allocate(SCENE_SECTION_TILES, tiles_memory_size(renderer_tiles_count), __alignof__(tRendererTile));
+    if (!block)
+        return false;
+    renderer_tiles = (tRendererTile *) block;
+    block += renderer_tiles_count * sizeof(tRendererTile);
+    renderer_tile_rects = (tRendererRect *) block;
+    block += renderer_tiles_count * sizeof(tRendererRect);
+    renderer_tile_appearance = (tRendererAppearance *) block;
+    block += renderer_tiles_count * sizeof(tRendererAppearance);
+    renderer_tile_visible = (uint32_t *) block;
+    renderer_tile_parent_visible = renderer_tile_visible + bitmap_words;
 
-    // fill tile table
     unsigned i;
-    for (i = 0; i < renderer_tiles_count; i++) {
-        tRendererTile *tile = renderer_tiles + i;
+    for (i = 0; i < bitmap_words; i++) {
+        renderer_tile_visible[i] = 0;
+        renderer_tile_parent_visible[i] = 0;
+    }
+    return true;
+}
 
-        // decode tree structure field
-        if (!input_get_word(custom, &tile->root_tile))
+static void map_tile_color(tRendererTile *tile) {
+    uint16_t color = renderer_colors[tile->color_handle];
+    tile->color.red = ((color >> 12) & 0x0f) * 17;
+    tile->color.green = ((color >> 8) & 0x0f) * 17;
+    tile->color.blue = ((color >> 4) & 0x0f) * 17;
+    tile->color.alpha = ((color >> 0) & 0x0f) * 17;
+}
+
+// end of the records decoded in this step
+static inline unsigned step_records_end(unsigned count) {
+    return (count - decoder_record > RECORDS_PER_STEP) ? decoder_record + RECORDS_PER_STEP : count;
+}
+
+static inline void step_records_done(unsigned next, unsigned count) {
+    decoder_record = next;
+    decoder_section_pending = next < count;
+}
+
+static bool decode_tiles(bool custom) {
+    if (!decoder_record) {
+        TRACE("- Decoding tiles")
+        // number of tiles
+        if (!input_get_word(custom, &renderer_tiles_count))
             return false;
-        if (!input_get_word(custom, &tile->parent_tile))
+        if (renderer_tiles_count > RENDERER_MAX_TILES) {
+            TRACE("-- Too many tiles %d", renderer_tiles_count)
             return false;
-        if (!input_get_word(custom, &tile->children_count))
+        }
+
+        // allocate memory
+        if (!allocate_tiles())
             return false;
-        if (!input_get_word(custom, &tile->children_list_index))
+    }
+
+    // fill tile table
+    unsigned i, end = step_records_end(renderer_tiles_count);
+    for (i = decoder_record; i < end; i++) {
+        tRendererTile *tile = renderer_tiles + i;
+        tRendererRect *rect = renderer_tile_rects + i;
+        const uint8_t *data = input_get_record(custom, TILE_RECORD_LENGTH);
+        if (!data)
             return false;
 
+        tile->glyph = RENDERER_NULL_HANDLE;
+
+        // decode tree structure field
+        tile->root_tile = le16(data);
+        tile->parent_tile = le16(data + 2);
+        tile->children_count = le16(data + 4);
+        tile->children_list_index = le16(data + 6);
+
         // position
-        if (!input_get_word(custom, &tile->position_left))
-            return false;
-        if (!input_get_word(custom, &tile->position_top))
-            return false;
-        if (!input_get_word(custom, &tile->position_width))
-            return false;
-        if (!input_get_word(custom, &tile->position_height))
-            return false;
-        uint8_t visible;
-        if (!input_get_byte(custom, &visible))
-            return false;
-        tile->tile_visible = visible == 1;
-        tile->parent_visible = true;
+        rect->left = le16(data + 8);
+        rect->top = le16(data + 10);
+        tile->position_width = le16(data + 12);
+        tile->position_height = le16(data + 14);
+        renderer_bit_set(renderer_tile_visible, i, data[16] == 1);
+        renderer_bit_set(renderer_tile_parent_visible, i, true);
 
         // update rendering position
-        tile->position_right = tile->position_left + tile->position_width - 1;
-        tile->position_bottom = tile->position_top + tile->position_height - 1;
+        rect->right = rect->left + tile->position_width - 1;
+        rect->bottom = rect->top + tile->position_height - 1;
 
         // color
-        if (!input_get_word(custom, &tile->color_handle))
+        tile->color_handle = le16(data + 17);
+        if (tile->color_handle >= renderer_colors_simple_count)
             return false;
         // FIXME: map handle to color
-        uint16_t color = renderer_colors[tile->color_handle];
-        tile->color.red = ((color >> 12) & 0x0f) * 17;
-        tile->color.green = ((color >> 8) & 0x0f) * 17;
-        tile->color.blue = ((color >> 4) & 0x0f) * 17;
-        tile->color.alpha = ((color >> 0) & 0x0f) * 17;
+        map_tile_color(tile);
 
         // decode tile type
-        uint8_t tile_type;
-        if (!input_get_byte(custom, &tile_type))
-            return false;
-        switch (tile_type) {
+        switch (data[19]) {
             case 0:
                 tile->rendering_mode = COLOR;
                 break;
@@ -235,13 +373,23 @@ static bool decode_tiles(bool custom) {
         }
 
         // decode texture properties
-        if (tile_type == 1) {
-            if (!decode_texture(custom, &tile->texture))
+        if (tile->rendering_mode == ALPHA_TEXTURE) {
+            data = input_get_record(custom, TEXTURE_RECORD_LENGTH);
+            if (!data || !decode_texture(data, &tile->texture))
                 return false;
+        } else {
+            // (scene memory is reused)
+            tile->texture.base = 0;
+            tile->texture.stripe_length = 0;
+            tile->texture.packed_alpha = false;
         }
+
+        renderer_tile_appearance[i] = renderer_appearance_pack(tile);
     }
+    step_records_done(i, renderer_tiles_count);
 
-    TRACE("- Decoded %d tiles", renderer_tiles_count)
+    if (!decoder_section_pending)
+        TRACE("- Decoded %d tiles", renderer_tiles_count)
 
     return true;
 }
@@ -252,21 +400,26 @@ static bool decode_screens(bool custom) {
     if (!input_get_word(custom, &renderer_screen_count))
         return false;
 
-    if (renderer_screen_count != 1) {
-        TRACE("-- Invalid number of screens %d", renderer_screen_count)
+    if (renderer_screen_count == 0) {
+        TRACE("-- No screens")
         return false;
     }
 
     // allocate memory
-    renderer_screens = allocate(sizeof(tRendererScreen) * renderer_screen_count, 2);
+    tRendererScreen *screens = allocate(SCENE_SECTION_SCREENS, sizeof(tRendererScreen) * renderer_screen_count,
+                                        __alignof__(tRendererScreen));
+    if (!screens)
+        return false;
+    renderer_screens = screens;
 
     // fill screen table
     int i;
     for (i = 0; i < renderer_screen_count; i++) {
-        if (!input_get_word(custom, &renderer_screens[i].root_tile))
-            return false;
-        if (!input_get_word(custom, &renderer_screens[i].graphics))
+        const uint8_t *data = input_get_record(custom, SCREEN_RECORD_LENGTH);
+        if (!data)
             return false;
+        screens[i].root_tile = le16(data);
+        screens[i].graphics = le16(data + 2);
     }
 
     TRACE("- Decoded %d screens", renderer_screen_count)
@@ -282,14 +435,14 @@ static bool decode_child_index(bool custom) {
         return false;
 
     // allocate memory
-    renderer_child_index = allocate(renderer_child_index_count * 2, 2);
+    tRendererTileHandle *child_index = allocate(SCENE_SECTION_CHILD_INDEX, renderer_child_index_count * 2, 2);
+    if (!child_index)
+        return false;
+    renderer_child_index = child_index;
 
     // fill index
-    int i;
-    for (i = 0; i < renderer_child_index_count; i++) {
-        if (!input_get_word(custom, renderer_child_index + i))
-            return false;
-    }
+    if (!input_get_words(custom, child_index, renderer_child_index_count))
+        return false;
 
     TRACE("- Decoded %d records", renderer_child_index_count)
 
@@ -297,40 +450,45 @@ static bool decode_child_index(bool custom) {
 }
 
 static bool decode_font_glyphs(bool custom) {
-    TRACE("- Decoding font glyphs")
-    // number of glyphs
-    if (!input_get_word(custom, &renderer_font_glyphs_count))
-        return false;
+    if (!decoder_record) {
+        TRACE("- Decoding font glyphs")
+        // number of glyphs
+        if (!input_get_word(custom, &renderer_font_glyphs_count))
+            return false;
 
-    if (!renderer_font_glyphs_count) {
-        TRACE("- No font glyphs")
-        renderer_font_glyphs = NULL;
-        return true;
-    }
+        if (!renderer_font_glyphs_count) {
+            TRACE("- No font glyphs")
+            renderer_font_glyphs = NULL;
+            return true;
+        }
 
-    // allocate memory
-    renderer_font_glyphs = allocate(sizeof(tRendererFontGlyph) * renderer_font_glyphs_count, 4);
+        // allocate memory
+        renderer_font_glyphs = allocate(SCENE_SECTION_GLYPHS, sizeof(tRendererFontGlyph) * renderer_font_glyphs_count,
+                                        __alignof__(tRendererFontGlyph));
+        if (!renderer_font_glyphs)
+            return false;
+    }
+    tRendererFontGlyph *glyphs = (tRendererFontGlyph *) renderer_font_glyphs;
 
     // fetch each glyphs
-    int i;
-    for (i = 0; i < renderer_font_glyphs_count; i++) {
-        if (!input_get_word(custom, &renderer_font_glyphs[i].code_point))
-            return false;
-        if (!input_get_word(custom, &renderer_font_glyphs[i].width))
+    unsigned i, end = step_records_end(renderer_font_glyphs_count);
+    for (i = decoder_record; i < end; i++) {
+        const uint8_t *data = input_get_record(custom, GLYPH_RECORD_LENGTH);
+        if (!data)
             return false;
-        if (!input_get_word(custom, &renderer_font_glyphs[i].height))
-            return false;
-        if (!input_get_word(custom, (uint16_t *) &renderer_font_glyphs[i].offset_x))
-            return false;
-        if (!input_get_word(custom, (uint16_t *) &renderer_font_glyphs[i].offset_y))
-            return false;
-        if (!input_get_word(custom, &renderer_font_glyphs[i].advance_x))
-            return false;
-        if (!decode_texture(custom, &renderer_font_glyphs[i].texture))
+        glyphs[i].code_point = le16(data);
+        glyphs[i].width = le16(data + 2);
+        glyphs[i].height = le16(data + 4);
+        glyphs[i].offset_x = (int16_t) le16(data + 6);
+        glyphs[i].offset_y = (int16_t) le16(data + 8);
+        glyphs[i].advance_x = le16(data + 10);
+        if (!decode_texture(data + 12, &glyphs[i].texture))
             return false;
     }
+    step_records_done(i, renderer_font_glyphs_count);
 
-    TRACE("- Decoded %d font glyphs", renderer_font_glyphs_count)
+    if (!decoder_section_pending)
+        TRACE("- Decoded %d font glyphs", renderer_font_glyphs_count)
     return true;
 }
 
@@ -347,17 +505,21 @@ static bool decode_fonts(bool custom) {
     }
 
     // allocate memory
-    renderer_fonts = allocate(sizeof(tRendererFont) * renderer_fonts_count, 4);
+    tRendererFont *fonts = allocate(SCENE_SECTION_FONTS, sizeof(tRendererFont) * renderer_fonts_count,
+                                    __alignof__(tRendererFont));
+    if (!fonts)
+        return false;
+    renderer_fonts = fonts;
 
     // fetch each font
     int i;
     for (i = 0; i < renderer_fonts_count; i++) {
-        if (!input_get_word(custom, &renderer_fonts[i].glyph_count))
-            return false;
-        if (!input_get_word(custom, &renderer_fonts[i].first_glyph))
-            return false;
-        if (!input_get_word(custom, &renderer_fonts[i].space_width))
+        const uint8_t *data = input_get_record(custom, FONT_RECORD_LENGTH);
+        if (!data)
             return false;
+        fonts[i].glyph_count = le16(data);
+        fonts[i].first_glyph = le16(data + 2);
+        fonts[i].space_width = le16(data + 4);
     }
 
     TRACE("- Decoded %d fonts", renderer_fonts_count)
@@ -374,10 +536,10 @@ static bool decode_texts(bool custom) {
         return false;
 
     // number of texts
-    if (!input_get_word(custom, &renderer_texts_count))
+    if (!input_get_word(custom, &texts_count))
         return false;
 
-    if (!renderer_texts_count) {
+    if (!texts_count) {
         TRACE("- No texts")
         renderer_texts = NULL;
         return true;
@@ -387,28 +549,29 @@ static bool decode_texts(bool custom) {
         return false;
 
     // allocate memory for texts
-    uint16_t *texts = allocate(texts_length * 2, 2);
+    uint16_t *texts = allocate(SCENE_SECTION_TEXT_CHARACTERS, texts_length * 2, 2);
+    if (!texts)
+        return false;
+    const uint16_t *texts_end = texts + texts_length;
 
     // allocate memory
-    renderer_texts = allocate(sizeof(tRendererText) * renderer_texts_count, 4);
+    renderer_texts = allocate(SCENE_SECTION_TEXTS, sizeof(tRendererText) * texts_count,
+                              __alignof__(tRendererText));
+    if (!renderer_texts)
+        return false;
 
     // fetch each text
-    int i, j;
-    for (i = 0; i < renderer_texts_count; i++) {
-        if (!input_get_word(custom, &renderer_texts[i].tile_count))
-            return false;
-        if (!input_get_word(custom, &renderer_texts[i].tile))
-            return false;
-        if (!input_get_word(custom, &renderer_texts[i].font))
-            return false;
-        if (!input_get_word(custom, &renderer_texts[i].position_x))
-            return false;
-        if (!input_get_word(custom, &renderer_texts[i].position_y))
-            return false;
-        uint8_t b;
-        if (!input_get_byte(custom, &b))
+    int i;
+    for (i = 0; i < texts_count; i++) {
+        const uint8_t *data = input_get_record(custom, TEXT_RECORD_LENGTH);
+        if (!data)
             return false;
-        switch (b) {
+        renderer_texts[i].tile_count = le16(data);
+        renderer_texts[i].tile = le16(data + 2);
+        renderer_texts[i].font = le16(data + 4);
+        renderer_texts[i].position_x = le16(data + 6);
+        renderer_texts[i].position_y = le16(data + 8);
+        switch (data[10]) {
             case 1:
                 renderer_texts[i].alignment_h = TEXT_CENTER;
                 break;
@@ -420,9 +583,7 @@ static bool decode_texts(bool custom) {
                 renderer_texts[i].alignment_h = TEXT_LEFT;
                 break;
         }
-        if (!input_get_byte(custom, &b))
-            return false;
-        switch (b) {
+        switch (data[11]) {
             case 1:
                 renderer_texts[i].alignment_v = TEXT_MIDDLE;
                 break;
@@ -435,14 +596,14 @@ static bool decode_texts(bool custom) {
                 break;
         }
         renderer_texts[i].text = texts;
-        for (j = 0; j < renderer_texts[i].tile_count; j++) {
-            if (!input_get_word(custom, texts))
-                return false;
-            texts++;
-        }
+        if (texts + renderer_texts[i].tile_count > texts_end)
+            return false;
+        if (!input_get_words(custom, texts, renderer_texts[i].tile_count))
+            return false;
+        texts += renderer_texts[i].tile_count;
     }
 
-    TRACE("- Decoded %d texts", renderer_texts_count)
+    TRACE("- Decoded %d texts", texts_count)
 
     return true;
 }
@@ -455,17 +616,25 @@ static bool decode_texture_bundles(bool custom) {
         return false;
 
     // allocate memory
-    renderer_graphics = allocate(renderer_graphics_count, 4);
+    tRendererScreenGraphics *graphics = allocate(SCENE_SECTION_BUNDLES,
+                                                 sizeof(tRendererScreenGraphics) * renderer_graphics_count,
+                                                 __alignof__(tRendererScreenGraphics));
+    if (!graphics)
+        return false;
+    renderer_graphics = graphics;
 
     int i;
 
     // read each record
     for (i = 0; i < renderer_graphics_count; i++) {
-        if (!input_get_dword(custom, &renderer_graphics[i].base))
-            return false;
-
-        if (!input_get_dword(custom, &renderer_graphics[i].length))
+        const uint8_t *data = input_get_record(custom, BUNDLE_RECORD_LENGTH);
+        if (!data)
             return false;
+        graphics[i].base = le32(data);
+        graphics[i].length = le32(data + 4);
+        graphics[i].stored_length = graphics[i].length;
+        graphics[i].compression = RENDERER_COMPRESSION_NONE;
+        graphics[i].first_page = RENDERER_NULL_HANDLE;
 #ifdef TRACE_DECODER_DETAILS
         TRACE("-- Decoded bundle #%d addr=0x%08X, length=0x%08X", i,
               renderer_graphics[i].base, renderer_graphics[i].length)
@@ -477,68 +646,637 @@ static bool decode_texture_bundles(bool custom) {
     return true;
 }
 
-bool scene_decoder_use_default() {
-    return use_default;
+// frames must be ascending & inside the frame data (uploaded to the video memory start)
+static bool check_video(const tRendererVideoDescriptor *video) {
+    if (!video->frame_count)
+        return false;
+    unsigned i;
+    for (i = 0; i < video->frame_count; i++) {
+        if (video->frame_offsets[i] >= video->length
+            || (i && video->frame_offsets[i] <= video->frame_offsets[i - 1]))
+            return false;
+    }
+    return true;
 }
 
-bool scene_decoder_decode(bool custom) {
-    use_default = !custom;
+static bool decode_videos(bool custom) {
+    // images without videos end after the texture bundles
+    if (!input_available(2)) {
+        TRACE("- No videos")
+        renderer_videos = NULL;
+        return true;
+    }
 
-    TRACE("Decoding started")
-    if (!input_init(custom))
+    TRACE("- Decoding videos")
+    // count
+    if (!input_get_word(custom, &renderer_videos_count))
         return false;
 
-    // create color table
-    if (!decode_color_table(custom)) {
-        TRACE("Scene decoder: Invalid color table")
+    if (!renderer_videos_count) {
+        TRACE("- No videos")
+        renderer_videos = NULL;
+        return true;
+    }
+
+    // allocate memory
+    renderer_videos = allocate(SCENE_SECTION_VIDEOS, sizeof(tRendererVideoDescriptor) * renderer_videos_count,
+                               __alignof__(tRendererVideoDescriptor));
+    if (!renderer_videos)
         return false;
+
+    // read each record & its frames
+    unsigned i, j;
+    for (i = 0; i < renderer_videos_count; i++) {
+        tRendererVideoDescriptor *video = renderer_videos + i;
+        const uint8_t *data = input_get_record(custom, VIDEO_RECORD_LENGTH);
+        if (!data)
+            return false;
+        video->frame_count = le16(data);
+        video->base = le32(data + 2);
+        video->length = le32(data + 6);
+
+        uint32_t *frames = allocate(SCENE_SECTION_VIDEO_FRAMES, video->frame_count * sizeof(uint32_t), 4);
+        if (!frames)
+            return false;
+        for (j = 0; j < video->frame_count; j++) {
+            data = input_get_record(custom, VIDEO_FRAME_RECORD_LENGTH);
+            if (!data)
+                return false;
+            frames[j] = le32(data);
+        }
+        video->frame_offsets = frames;
+        if (!check_video(video))
+            return false;
     }
 
-    // decode tiles
-    if (!decode_tiles(custom)) {
-        TRACE("Scene decoder: Invalid tile list")
+    TRACE("- Decoded %d videos", renderer_videos_count)
+
+    return true;
+}
+
+// ***********************************************
+// **  DIRECT IMAGE                             **
+// ***********************************************
+
+static const tSceneSection *direct_section(eSceneSection section, unsigned record_size) {
+    const tSceneSection *descriptor = direct_header.section + section;
+    uint32_t size = ((uint32_t) descriptor->count) * record_size;
+    if (descriptor->record_size != record_size
+        || (descriptor->offset & 3)
+        || descriptor->offset < sizeof(tSceneHeader)
+        || descriptor->offset > input_data_length
+        || size > input_data_length - descriptor->offset) {
+        TRACE("-- Invalid section %d", section)
+        return NULL;
+    }
+    return descriptor;
+}
+
+static bool direct_verify(eSceneSection section, uint32_t crc) {
+    if (crc != direct_header.section[section].crc) {
+        TRACE("-- Section %d CRC mismatch", section)
         return false;
     }
+    return true;
+}
+
+// constant table: referenced in place or read to the scene memory
+static const void *direct_table(bool custom, eSceneSection section, unsigned record_size, uint16_t *count) {
+    const tSceneSection *descriptor = direct_section(section, record_size);
+    if (!descriptor)
+        return NULL;
+    *count = descriptor->count;
+    if (direct_in_place)
+        return renderer_data + descriptor->offset;
+
+    uint32_t size = ((uint32_t) descriptor->count) * record_size;
+    void *table = allocate(section, size, 4);
+    if (!table)
+        return NULL;
+    if (custom) {
+        spi_flash_read_sync(FLASH_BANK_SCENE, descriptor->offset, table, size);
+        if (!direct_verify(section, crc32_update(0, table, size)))
+            return NULL;
+    } else {
+        memcpy(table, renderer_data + descriptor->offset, size);
+    }
+    return table;
+}
 
-    // decode screens
-    if (!decode_screens(custom)) {
-        TRACE("Scene decoder: Invalid screen list")
+// record of a copied section: in place or through the input buffer
+// (records of the flash image are added to the section CRC)
+static const void *direct_record(bool custom, uint32_t position, unsigned record_size) {
+    if (direct_in_place)
+        return renderer_data + position;
+    input_position = position;
+    const uint8_t *record = input_get_record(custom, record_size);
+    if (custom)
+        decoder_crc = crc32_update(decoder_crc, record, record_size);
+    return record;
+}
+
+static bool decode_direct_tiles(bool custom) {
+    const tSceneSection *section = direct_section(SCENE_SECTION_TILES, sizeof(tSceneTile));
+    if (!section)
         return false;
+    if (!decoder_record) {
+        TRACE("- Decoding tiles")
+        decoder_crc = 0;
+        renderer_tiles_count = section->count;
+        if (renderer_tiles_count > RENDERER_MAX_TILES) {
+            TRACE("-- Too many tiles %d", renderer_tiles_count)
+            return false;
+        }
+
+        if (!allocate_tiles())
+            return false;
+    }
+
+    unsigned i, end = step_records_end(renderer_tiles_count);
+    for (i = decoder_record; i < end; i++) {
+        const tSceneTile *record = direct_record(custom, section->offset + i * sizeof(tSceneTile),
+                                                 sizeof(tSceneTile));
+        tRendererTile *tile = renderer_tiles + i;
+        tRendererRect *rect = renderer_tile_rects + i;
+        if (record->color_handle >= renderer_colors_simple_count || record->type > 1
+            || record->texture_compression > 1)
+            return false;
+
+        tile->root_tile = record->root_tile;
+        tile->parent_tile = record->parent_tile;
+        tile->children_count = record->children_count;
+        tile->children_list_index = record->children_list_index;
+        tile->gauge_marks_count = 0;
+        tile->position_width = record->width;
+        tile->position_height = record->height;
+        rect->left = record->left;
+        rect->top = record->top;
+        rect->right = rect->left + tile->position_width - 1;
+        rect->bottom = rect->top + tile->position_height - 1;
+        renderer_bit_set(renderer_tile_visible, i, record->visible == 1);
+        renderer_bit_set(renderer_tile_parent_visible, i, true);
+
+        tile->color_handle = record->color_handle;
+        map_tile_color(tile);
+
+        tile->rendering_mode = (record->type == 1) ? ALPHA_TEXTURE : COLOR;
+        tile->texture.base = record->texture_base;
+        tile->texture.stripe_length = record->texture_stripe_length;
+        tile->texture.packed_alpha = (record->texture_compression == 1);
+        tile->glyph = RENDERER_NULL_HANDLE;
+
+        renderer_tile_appearance[i] = renderer_appearance_pack(tile);
     }
+    step_records_done(i, renderer_tiles_count);
+
+    if (decoder_section_pending)
+        return true;
+    if (custom && !direct_verify(SCENE_SECTION_TILES, decoder_crc))
+        return false;
+    TRACE("- Decoded %d tiles", renderer_tiles_count)
+    return true;
+}
 
-    // decode node child index
-    if (!decode_child_index(custom)) {
-        TRACE("Scene decoder: Invalid child index")
+static bool decode_direct_texts(bool custom) {
+    TRACE("- Decoding texts")
+    uint16_t characters_count;
+    const uint16_t *characters = direct_table(custom, SCENE_SECTION_TEXT_CHARACTERS, sizeof(uint16_t),
+                                              &characters_count);
+    const tSceneSection *section = direct_section(SCENE_SECTION_TEXTS, sizeof(tSceneText));
+    if (!characters || !section)
+        return false;
+    texts_count = section->count;
+    renderer_texts = allocate(SCENE_SECTION_TEXTS, sizeof(tRendererText) * texts_count,
+                              __alignof__(tRendererText));
+    if (!renderer_texts)
         return false;
+    decoder_crc = 0;
+
+    unsigned i;
+    for (i = 0; i < texts_count; i++) {
+        const tSceneText *record = direct_record(custom, section->offset + i * sizeof(tSceneText),
+                                                 sizeof(tSceneText));
+        tRendererText *text = renderer_texts + i;
+        if (record->first_character + record->tile_count > characters_count)
+            return false;
+        text->tile_count = record->tile_count;
+        text->tile = record->tile;
+        text->font = record->font;
+        text->position_x = record->position_x;
+        text->position_y = record->position_y;
+        text->alignment_h = (record->alignment_h == 1) ? TEXT_CENTER :
+                            (record->alignment_h == 2) ? TEXT_RIGHT : TEXT_LEFT;
+        text->alignment_v = (record->alignment_v == 1) ? TEXT_MIDDLE :
+                            (record->alignment_v == 2) ? TEXT_BOTTOM : TEXT_TOP;
+        text->text = characters + record->first_character;
     }
+    if (custom && !direct_verify(SCENE_SECTION_TEXTS, decoder_crc))
+        return false;
 
-    // decode font glyphs
-    if (!decode_font_glyphs(custom)) {
-        TRACE("Scene decoder: Invalid glyph list")
+    TRACE("- Decoded %d texts", texts_count)
+    return true;
+}
+
+static bool decode_direct_videos(bool custom) {
+    TRACE("- Decoding videos")
+    uint16_t frames_count;
+    const uint32_t *frames = direct_table(custom, SCENE_SECTION_VIDEO_FRAMES, sizeof(uint32_t), &frames_count);
+    const tSceneSection *section = direct_section(SCENE_SECTION_VIDEOS, sizeof(tSceneVideo));
+    if (!frames || !section)
         return false;
+    renderer_videos_count = section->count;
+    renderer_videos = allocate(SCENE_SECTION_VIDEOS, sizeof(tRendererVideoDescriptor) * renderer_videos_count,
+                               __alignof__(tRendererVideoDescriptor));
+    if (!renderer_videos)
+        return false;
+    decoder_crc = 0;
+
+    unsigned i;
+    for (i = 0; i < renderer_videos_count; i++) {
+        const tSceneVideo *record = direct_record(custom, section->offset + i * sizeof(tSceneVideo),
+                                                  sizeof(tSceneVideo));
+        tRendererVideoDescriptor *video = renderer_videos + i;
+        if (record->first_frame + record->frame_count > frames_count)
+            return false;
+        video->frame_count = record->frame_count;
+        video->frame_offsets = frames + record->first_frame;
+        video->base = record->base;
+        video->length = record->length;
+        if (!check_video(video))
+            return false;
     }
+    if (custom && !direct_verify(SCENE_SECTION_VIDEOS, decoder_crc))
+        return false;
+
+    TRACE("- Decoded %d videos", renderer_videos_count)
+    return true;
+}
 
-    // decode fonts
-    if (!decode_fonts(custom)) {
-        TRACE("Scene decoder: Invalid font list")
+static bool decode_direct_colors(bool custom) {
+    renderer_colors = direct_table(custom, SCENE_SECTION_COLORS, sizeof(uint16_t), &renderer_colors_simple_count);
+    return renderer_colors != NULL;
+}
+
+static bool decode_direct_screens(bool custom) {
+    renderer_screens = direct_table(custom, SCENE_SECTION_SCREENS, sizeof(tRendererScreen), &renderer_screen_count);
+    return renderer_screens != NULL && renderer_screen_count != 0;
+}
+
+static bool decode_direct_child_index(bool custom) {
+    renderer_child_index = direct_table(custom, SCENE_SECTION_CHILD_INDEX, sizeof(tRendererTileHandle),
+                                        &renderer_child_index_count);
+    return renderer_child_index != NULL;
+}
+
+static bool decode_direct_glyphs(bool custom) {
+    renderer_font_glyphs = direct_table(custom, SCENE_SECTION_GLYPHS, sizeof(tRendererFontGlyph),
+                                        &renderer_font_glyphs_count);
+    return renderer_font_glyphs != NULL;
+}
+
+static bool decode_direct_fonts(bool custom) {
+    renderer_fonts = direct_table(custom, SCENE_SECTION_FONTS, sizeof(tRendererFont), &renderer_fonts_count);
+    return renderer_fonts != NULL;
+}
+
+static bool decode_direct_bundles(bool custom) {
+    renderer_graphics = direct_table(custom, SCENE_SECTION_BUNDLES, sizeof(tRendererScreenGraphics),
+                                     &renderer_graphics_count);
+    if (!renderer_graphics)
         return false;
+    renderer_graphics_pages = direct_table(custom, SCENE_SECTION_BUNDLE_PAGES, sizeof(uint32_t),
+                                           &renderer_graphics_pages_count);
+    if (!renderer_graphics_pages)
+        return false;
+
+    // stored length differs for the compressed bundles only
+    unsigned i;
+    for (i = 0; i < renderer_graphics_count; i++) {
+        const tRendererScreenGraphics *graphics = renderer_graphics + i;
+        uint32_t pages = (graphics->length + RENDERER_BUNDLE_PAGE_SIZE - 1) / RENDERER_BUNDLE_PAGE_SIZE;
+        if (graphics->compression > RENDERER_COMPRESSION_RLE
+            || (graphics->compression == RENDERER_COMPRESSION_NONE && graphics->stored_length != graphics->length)
+            || (graphics->first_page != RENDERER_NULL_HANDLE
+                && graphics->first_page + pages > renderer_graphics_pages_count))
+            return false;
     }
+    return true;
+}
 
-    // decode texts
-    if (!decode_texts(custom)) {
-        TRACE("Scene decoder: Invalid text list")
+static bool direct_init(bool custom) {
+    memcpy(&direct_header, input_buffer, sizeof(tSceneHeader));
+    if (direct_header.version != SCENE_DIRECT_VERSION || direct_header.section_count != SCENE_SECTION_COUNT) {
+        TRACE("Scene decoder: Unsupported image version %d", direct_header.version)
         return false;
     }
+    if (custom && crc32_update(0, (const uint8_t *) &direct_header, sizeof(tSceneHeader) - 4) != direct_header.crc) {
+        TRACE("Scene decoder: Header CRC mismatch")
+        return false;
+    }
+    direct_in_place = !custom && !(((uintptr_t) renderer_data) & 3);
+    TRACE("- Direct image%s", direct_in_place ? " (in place)" : "")
+    return true;
+}
+
+// constant table read to the scene memory
+static inline uint32_t direct_table_memory(uint32_t size, eSceneSection section) {
+    if (direct_in_place)
+        return size;
+    const tSceneSection *descriptor = direct_header.section + section;
+    return memory_align(size, 4) + ((uint32_t) descriptor->count) * descriptor->record_size;
+}
+
+// scene memory needed by the direct image (allocations in the order of the decoding steps)
+static uint32_t direct_memory_required() {
+    uint32_t size = direct_table_memory(0, SCENE_SECTION_COLORS);
+    size = memory_align(size, __alignof__(tRendererTile))
+           + tiles_memory_size(direct_header.section[SCENE_SECTION_TILES].count);
+    size = direct_table_memory(size, SCENE_SECTION_SCREENS);
+    size = direct_table_memory(size, SCENE_SECTION_CHILD_INDEX);
+    size = direct_table_memory(size, SCENE_SECTION_BUNDLES);
+    size = direct_table_memory(size, SCENE_SECTION_BUNDLE_PAGES);
+    size = direct_table_memory(size, SCENE_SECTION_GLYPHS);
+    size = direct_table_memory(size, SCENE_SECTION_FONTS);
+    size = direct_table_memory(size, SCENE_SECTION_TEXT_CHARACTERS);
+    size = memory_align(size, __alignof__(tRendererText))
+           + ((uint32_t) direct_header.section[SCENE_SECTION_TEXTS].count) * sizeof(tRendererText);
+    size = direct_table_memory(size, SCENE_SECTION_VIDEO_FRAMES);
+    size = memory_align(size, __alignof__(tRendererVideoDescriptor))
+           + ((uint32_t) direct_header.section[SCENE_SECTION_VIDEOS].count) * sizeof(tRendererVideoDescriptor);
+    if (direct_header.section[SCENE_SECTION_FONTS].count) {
+        size = memory_align(size, __alignof__(tRendererFontIndex))
+               + ((uint32_t) direct_header.section[SCENE_SECTION_FONTS].count) * sizeof(tRendererFontIndex);
+        size = memory_align(size, 2) + ((uint32_t) direct_header.section[SCENE_SECTION_GLYPHS].count) * 2;
+    }
+    return size;
+}
 
-    //decode graphics contexts
-    if (!decode_texture_bundles(custom)) {
-        TRACE("Scene decoder: Invalid texture bundles")
+// ***********************************************
+// **  VALIDATION                               **
+// ***********************************************
+
+// handles used by the screen rendering
+static bool validate_screen_tables(bool custom) {
+    unsigned i;
+    for (i = 0; i < renderer_tiles_count; i++) {
+        const tRendererTile *tile = renderer_tiles + i;
+        if (tile->root_tile >= renderer_tiles_count
+            || (tile->parent_tile >= renderer_tiles_count && tile->parent_tile != RENDERER_NULL_HANDLE)
+            || tile->children_list_index + tile->children_count > renderer_child_index_count)
+            return false;
+    }
+    for (i = 0; i < renderer_child_index_count; i++) {
+        if (renderer_child_index[i] >= renderer_tiles_count)
+            return false;
+    }
+    for (i = 0; i < renderer_screen_count; i++) {
+        if (renderer_screens[i].root_tile >= renderer_tiles_count
+            || renderer_screens[i].graphics >= renderer_graphics_count)
+            return false;
+    }
+    return true;
+}
+
+// handles used by the text layout
+static bool validate_text_tables(bool custom) {
+    unsigned i;
+    for (i = 0; i < renderer_fonts_count; i++) {
+        if (renderer_fonts[i].first_glyph + renderer_fonts[i].glyph_count > renderer_font_glyphs_count)
+            return false;
+    }
+    for (i = 0; i < texts_count; i++) {
+        if (renderer_texts[i].font >= renderer_fonts_count
+            || renderer_texts[i].tile + renderer_texts[i].tile_count > renderer_tiles_count)
+            return false;
+    }
+    return true;
+}
+
+// ***********************************************
+// **  GLYPH LOOKUP                             **
+// ***********************************************
+
+static bool index_fonts(bool custom) {
+    if (!renderer_fonts_count) {
+        renderer_font_index = NULL;
+        renderer_glyph_order = NULL;
+        return true;
+    }
+
+    // allocate memory
+    tRendererFontIndex *index = allocate(SCENE_SECTION_FONTS, sizeof(tRendererFontIndex) * renderer_fonts_count,
+                                         __alignof__(tRendererFontIndex));
+    uint16_t *order = allocate(SCENE_SECTION_GLYPHS, renderer_font_glyphs_count * 2, 2);
+    if (!index || !order)
         return false;
+    renderer_font_index = index;
+    renderer_glyph_order = order;
+
+    unsigned f, i, j;
+    for (f = 0; f < renderer_fonts_count; f++, index++) {
+        const tRendererFont *font = renderer_fonts + f;
+
+        // glyph ranges are shared whole or not at all (sorted in place)
+        for (i = 0; i < f; i++) {
+            const tRendererFont *other = renderer_fonts + i;
+            if (font->first_glyph < other->first_glyph + other->glyph_count
+                && other->first_glyph < font->first_glyph + font->glyph_count
+                && (font->first_glyph != other->first_glyph || font->glyph_count != other->glyph_count)) {
+                TRACE("-- Font %d overlaps font %d", f, i)
+                return false;
+            }
+        }
+
+        for (i = 0; i < RENDERER_GLYPH_ASCII_COUNT; i++)
+            index->ascii[i] = RENDERER_NULL_HANDLE;
+
+        // insertion sort by the code point (stable -> first glyph of the code point wins)
+        uint16_t *font_order = order + font->first_glyph;
+        for (i = 0; i < font->glyph_count; i++) {
+            uint16_t glyph = font->first_glyph + i;
+            uint16_t code_point = renderer_font_glyphs[glyph].code_point;
+            for (j = i; j > 0 && renderer_font_glyphs[font_order[j - 1]].code_point > code_point; j--)
+                font_order[j] = font_order[j - 1];
+            font_order[j] = glyph;
+
+            unsigned ascii = code_point - RENDERER_GLYPH_ASCII_FIRST;
+            if (ascii < RENDERER_GLYPH_ASCII_COUNT && index->ascii[ascii] == RENDERER_NULL_HANDLE)
+                index->ascii[ascii] = glyph;
+        }
     }
 
-    // TODO: video index decoding
+    TRACE("- Indexed %d fonts", renderer_fonts_count)
+    return true;
+}
+
+// ***********************************************
+// **  DECODING STEPS                           **
+// ***********************************************
+
+// stream image: sections in the stream order
+static const tDecodeStep stream_steps[] = {
+        {decode_color_table,     "Invalid color table"},
+        {decode_tiles,           "Invalid tile list"},
+        {decode_screens,         "Invalid screen list"},
+        {decode_child_index,     "Invalid child index"},
+        {decode_font_glyphs,     "Invalid glyph list"},
+        {decode_fonts,           "Invalid font list"},
+        {decode_texts,           "Invalid text list"},
+        {decode_texture_bundles, "Invalid texture bundles"},
+        {decode_videos,          "Invalid video list"},
+        {validate_screen_tables, "Invalid tile tree"},
+        {validate_text_tables,   "Invalid text references"},
+        {index_fonts,            "Invalid font list"},
+};
+#define STREAM_STEPS_COUNT              (sizeof(stream_steps) / sizeof(stream_steps[0]))
+
+// direct image: sections needed by the screen first
+static const tDecodeStep direct_steps[] = {
+        {decode_direct_colors,      "Invalid color table"},
+        {decode_direct_tiles,       "Invalid tile list"},
+        {decode_direct_screens,     "Invalid screen list"},
+        {decode_direct_child_index, "Invalid child index"},
+        {decode_direct_bundles,     "Invalid texture bundles"},
+        {validate_screen_tables,    "Invalid tile tree"},
+        {decode_direct_glyphs,      "Invalid glyph list"},
+        {decode_direct_fonts,       "Invalid font list"},
+        {decode_direct_texts,       "Invalid text list"},
+        {decode_direct_videos,      "Invalid video list"},
+        {validate_text_tables,      "Invalid text references"},
+        {index_fonts,               "Invalid font list"},
+};
+#define DIRECT_STEPS_COUNT              (sizeof(direct_steps) / sizeof(direct_steps[0]))
+#define DIRECT_SCREEN_STEPS             6
+
+// the renderer drops the shown screen (it refers to the tables)
+static void reset_tables() {
+    renderer_reset();
+    renderer_colors_simple_count = 0;
+    renderer_tiles_count = 0;
+    renderer_screen_count = 0;
+    renderer_child_index_count = 0;
+    renderer_font_glyphs_count = 0;
+    renderer_fonts_count = 0;
+    renderer_font_index = NULL;
+    renderer_glyph_order = NULL;
+    renderer_texts_count = 0;
+    texts_count = 0;
+    renderer_graphics_count = 0;
+    renderer_graphics_pages = NULL;
+    renderer_graphics_pages_count = 0;
     renderer_videos_count = 0;
+}
+
+bool scene_decoder_use_default() {
+    return use_default;
+}
 
-    TRACE("Decoding finished, memory used = %d bytes", memory_size)
+// invalid custom scene -> built-in scene is decoded
+static bool decoding_failed() {
+    reset_tables();
+    if (decoder_custom) {
+        TRACE("Scene decoder: Falling back to the built-in scene")
+        return scene_decoder_start(false);
+    }
+    decoder_status = SCENE_DECODER_FAILED;
+    return false;
+}
+
+bool scene_decoder_start(bool custom) {
+    use_default = !custom;
+    decoder_custom = custom;
+    decoder_step = 0;
+    decoder_record = 0;
+    decoder_section_pending = false;
+    reset_tables();
+    memory_reset();
+
+    TRACE("Decoding started")
+    if (!input_init(custom)) {
+        TRACE("Scene decoder: Invalid image header")
+        return decoding_failed();
+    }
+
+    if (input_magic == SCENE_MAGIC_DIRECT) {
+        if (!direct_init(custom))
+            return decoding_failed();
+        memory_required = direct_memory_required();
+        if (memory_required > memory_capacity) {
+            TRACE("Scene decoder: Scene needs %d bytes of memory, %d available", memory_required, memory_capacity)
+            return decoding_failed();
+        }
+        decoder_steps = direct_steps;
+        decoder_steps_count = DIRECT_STEPS_COUNT;
+        decoder_screen_steps = DIRECT_SCREEN_STEPS;
+    } else {
+        if (custom)
+            TRACE("Scene decoder: Stream image is not integrity checked")
+        decoder_steps = stream_steps;
+        decoder_steps_count = STREAM_STEPS_COUNT;
+        decoder_screen_steps = STREAM_STEPS_COUNT;
+    }
+    decoder_status = SCENE_DECODER_DECODING;
     return true;
 }
+
+bool scene_decoder_handle() {
+    if (decoder_status != SCENE_DECODER_DECODING && decoder_status != SCENE_DECODER_SCREEN_READY)
+        return false;
+
+    const tDecodeStep *step = decoder_steps + decoder_step;
+    if (!step->decode(decoder_custom)) {
+        TRACE("Scene decoder: %s", step->error)
+        decoding_failed();
+        return true;
+    }
+
+    // section finished?
+    if (decoder_section_pending)
+        return true;
+    decoder_record = 0;
+    decoder_step++;
+
+    if (decoder_step == decoder_steps_count) {
+        TRACE("Decoding finished, memory used = %d of %d bytes", memory_size, memory_capacity)
+#ifdef TRACE_DECODER_DETAILS
+        unsigned i;
+        for (i = 0; i < SCENE_SECTION_COUNT; i++)
+            TRACE("-- Section %d: %d bytes", i, memory_usage[i])
+#endif
+        memory_required = memory_size;
+        renderer_texts_count = texts_count;
+        decoder_status = SCENE_DECODER_FINISHED;
+    } else if (decoder_step == decoder_screen_steps) {
+        TRACE("- Screen ready")
+        decoder_status = SCENE_DECODER_SCREEN_READY;
+    }
+    return true;
+}
+
+eSceneDecoderStatus scene_decoder_status() {
+    return decoder_status;
+}
+
+void scene_decoder_set_memory(void *region, uint32_t size) {
+    if (region) {
+        memory = region;
+        memory_capacity = size;
+    } else {
+        memory = scene_memory;
+        memory_capacity = SCENE_MEMORY;
+    }
+}
+
+void scene_decoder_get_memory(tSceneDecoderMemory *report) {
+    report->capacity = memory_capacity;
+    report->used = memory_size;
+    report->required = memory_required;
+    memcpy(report->section, memory_usage, sizeof(report->section));
+}
+
+bool scene_decoder_decode(bool custom) {
+    if (!scene_decoder_start(custom))
+        return false;
+    while (scene_decoder_handle());
+    return decoder_status == SCENE_DECODER_FINISHED;
+}
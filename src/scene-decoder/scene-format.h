@@ -0,0 +1,94 @@
+#ifndef RENDERER_SCENE_FORMAT_H
+#define RENDERER_SCENE_FORMAT_H
+
+#include <stdint.h>
+#include "renderer-definition.h"
+
+// Scene images:
+//  - stream image (magic SCENE_MAGIC_STREAM): byte stream decoded field by field
+//  - direct image (magic SCENE_MAGIC_DIRECT): little-endian, 4-byte aligned tables
+//    laid out as the renderer structures, used in place when the image is
+//    addressable (built-in renderer_data), only mutable state is copied to RAM
+// Direct images read from the flash are verified by the section CRCs while
+// the sections are read, the built-in image is trusted.
+
+#define SCENE_MAGIC_STREAM              0xDEADBEEF
+#define SCENE_MAGIC_DIRECT              0xDEADBE02
+
+#define SCENE_DIRECT_VERSION            5
+
+// sections of the direct image (in this order)
+typedef enum eSceneSection {
+    SCENE_SECTION_COLORS,           // uint16_t
+    SCENE_SECTION_TILES,            // tSceneTile (copied to RAM)
+    SCENE_SECTION_SCREENS,          // tRendererScreen
+    SCENE_SECTION_CHILD_INDEX,      // tRendererTileHandle
+    SCENE_SECTION_GLYPHS,           // tRendererFontGlyph
+    SCENE_SECTION_FONTS,            // tRendererFont
+    SCENE_SECTION_TEXTS,            // tSceneText (copied to RAM)
+    SCENE_SECTION_TEXT_CHARACTERS,  // uint16_t
+    SCENE_SECTION_BUNDLES,          // tRendererScreenGraphics (optionally compressed)
+    SCENE_SECTION_VIDEOS,           // tSceneVideo (copied to RAM)
+    SCENE_SECTION_VIDEO_FRAMES,     // uint32_t
+    SCENE_SECTION_BUNDLE_PAGES,     // uint32_t (page hashes)
+    SCENE_SECTION_COUNT
+} eSceneSection;
+
+typedef struct tSceneSection {
+    uint32_t offset;                // from the image start, 4-byte aligned
+    uint16_t count;
+    uint16_t record_size;           // must match the structure size
+    uint32_t crc;                   // CRC-32 of the section data
+} tSceneSection;
+
+typedef struct tSceneHeader {
+    uint32_t magic;
+    uint32_t length;                // whole image
+    uint16_t version;
+    uint16_t section_count;
+    tSceneSection section[SCENE_SECTION_COUNT];
+    uint32_t crc;                   // CRC-32 of the header before this field
+} tSceneHeader;
+
+// tile record
+typedef struct tSceneTile {
+    uint32_t texture_base;
+    tRendererTileHandle root_tile;
+    tRendererTileHandle parent_tile;
+    uint16_t children_count;
+    uint16_t children_list_index;
+    tRendererPosition left;
+    tRendererPosition top;
+    tRendererPosition width;
+    tRendererPosition height;
+    tRendererColorHandle color_handle;
+    uint16_t texture_stripe_length;
+    uint8_t visible;                // 0/1
+    uint8_t type;                   // 0: color, 1: alpha texture
+    uint8_t texture_compression;    // 0: none, 1: packed alpha
+    uint8_t reserved;
+} tSceneTile;
+
+// text record
+typedef struct tSceneText {
+    uint16_t tile_count;
+    tRendererTileHandle tile;
+    uint16_t font;
+    tRendererPosition position_x;
+    tRendererPosition position_y;
+    uint8_t alignment_h;            // 0: left, 1: center, 2: right
+    uint8_t alignment_v;            // 0: top, 1: middle, 2: bottom
+    uint16_t first_character;       // index to SCENE_SECTION_TEXT_CHARACTERS
+    uint16_t reserved;
+} tSceneText;
+
+// video record
+typedef struct tSceneVideo {
+    uint32_t base;                  // frame data in the image
+    uint32_t length;
+    uint16_t frame_count;
+    uint16_t reserved;
+    uint32_t first_frame;           // index to SCENE_SECTION_VIDEO_FRAMES
+} tSceneVideo;
+
+#endif //RENDERER_SCENE_FORMAT_H
@@ -1,18 +1,45 @@
 //
 // Created by tumap on 8/29/23.
 //
+#include <profile.h>
+#include <renderer-definition.h>
 #include "system-config.h"
 #include "data-upload.h"
 #include "spi-flash.h"
 #include "scene-decoder.h"
 #include "memcpy.h"
+#include "trace.h"
+#ifdef UPLOAD_CHAIN
+#include "upload-chain.h"
+#endif
+
+// Chunks are read from the flash into a ring of buffers and uploaded in
+// order, the flash read of the next chunks overlaps the upload of the
+// previous one (one flash read & one upload in flight).
+// Addressable sources are uploaded straight from the memory, without the
+// buffers.
+// Compressed sources are unpacked from the read chunks (or the memory)
+// into a second pair of buffers, which are uploaded instead.
+// Chunks are the pages of the target, pages marked as skipped are left out.
+// With UPLOAD_CHAIN uncompressed flash sources are queued to the chained DMA
+// as descriptors instead, the data never passes through the CPU.
 
 static tUploadDataRequest *current;
 static uint32_t position;
+static uint32_t source_length;
+static const uint8_t *source;
+
+#ifndef UPLOAD_DIRECT_CHUNK
+#define UPLOAD_DIRECT_CHUNK (16*1024)
+#endif
 
-#define BUFFER_SIZE         4096
-static uint8_t bufferA_data[BUFFER_SIZE];
-static uint8_t bufferB_data[BUFFER_SIZE];
+#define BUFFER_SIZE         RENDERER_BUNDLE_PAGE_SIZE
+#ifndef UPLOAD_BUFFERS
+#define UPLOAD_BUFFERS      2
+#endif
+#define UNPACK_BUFFERS      2
+static uint8_t buffer_data[UPLOAD_BUFFERS][BUFFER_SIZE];
+static uint8_t unpack_data[UNPACK_BUFFERS][BUFFER_SIZE];
 
 typedef enum tagBufferState {
     BUFFER_STATE_IDLE,
@@ -24,112 +51,437 @@ typedef enum tagBufferState {
 typedef struct tagBuffer {
     uint8_t *buffer;
     eBufferState state;
+    // source offset (read buffers) or target offset (unpack buffers)
     uint32_t position;
     uint32_t length;
+    // bytes already unpacked (read buffers)
+    uint32_t consumed;
+    tSPIFlashRequest read_request;
 } tBuffer;
 
-static tBuffer bufferA;
-static tBuffer bufferB;
+static tBuffer buffers[UPLOAD_BUFFERS];
+// next buffer to read into & next buffer to upload (or unpack)
+static unsigned read_index;
+static unsigned upload_index;
+// flash read in flight (may outlive a cancelled request)
+static tSPIFlashRequest *pending_read;
+static tBuffer *uploading;
+
+static tTime start_time;
+
+static inline unsigned next_buffer(unsigned index) {
+    return (index + 1 == UPLOAD_BUFFERS) ? 0 : index + 1;
+}
+
+static inline bool page_skipped(uint32_t offset) {
+    return current->skip_pages && renderer_bit_get(current->skip_pages, offset / BUFFER_SIZE);
+}
+
+// uncompressed source -> skipped pages are not read
+static void skip_pages() {
+    while (position != source_length && page_skipped(position)) {
+        position += BUFFER_SIZE;
+        if (position > source_length)
+            position = source_length;
+    }
+}
+
+// *******************************************
+// **  RLE UNPACKING                        **
+// *******************************************
+
+static tBuffer unpack_buffers[UNPACK_BUFFERS];
+// buffer being filled & next buffer to upload
+static unsigned fill_index;
+static unsigned unpack_upload_index;
+// target bytes unpacked so far
+static uint32_t unpacked;
+
+// run split between the inputs
+static uint16_t literal_left;
+static uint16_t repeat_left;
+static bool repeat_value_pending;
+static uint8_t repeat_value;
+
+static inline unsigned next_unpack_buffer(unsigned index) {
+    return (index + 1 == UNPACK_BUFFERS) ? 0 : index + 1;
+}
+
+static void unpack_reset() {
+    unsigned i;
+    for (i = 0; i < UNPACK_BUFFERS; i++) {
+        unpack_buffers[i].buffer = unpack_data[i];
+        unpack_buffers[i].state = BUFFER_STATE_IDLE;
+        unpack_buffers[i].length = 0;
+    }
+    fill_index = 0;
+    unpack_upload_index = 0;
+    unpacked = 0;
+    literal_left = 0;
+    repeat_left = 0;
+    repeat_value_pending = false;
+}
+
+// unpacks the input into the output (until it is full), returns the input bytes used
+static uint32_t unpack(const uint8_t *input, uint32_t length, tBuffer *output, uint32_t output_size) {
+    const uint8_t *in = input;
+    const uint8_t *in_end = input + length;
+    uint8_t *out = output->buffer + output->length;
+    uint8_t *out_end = output->buffer + output_size;
+
+    while (out != out_end) {
+        uint32_t n;
+        if (literal_left) {
+            n = literal_left;
+            if (n > in_end - in)
+                n = in_end - in;
+            if (n > out_end - out)
+                n = out_end - out;
+            if (!n)
+                break;
+            memcpy(out, in, n);
+            in += n;
+            out += n;
+            literal_left -= n;
+        } else if (repeat_left) {
+            if (repeat_value_pending) {
+                if (in == in_end)
+                    break;
+                repeat_value = *in++;
+                repeat_value_pending = false;
+            }
+            n = repeat_left;
+            if (n > out_end - out)
+                n = out_end - out;
+            memset(out, repeat_value, n);
+            out += n;
+            repeat_left -= n;
+        } else {
+            if (in == in_end)
+                break;
+            uint8_t control = *in++;
+            if (control < 0x80) {
+                literal_left = control + 1;
+            } else {
+                repeat_left = control - 0x7e;
+                repeat_value_pending = true;
+            }
+        }
+    }
+
+    output->length = out - output->buffer;
+    return in - input;
+}
+
+// whole source read & used
+static bool input_consumed() {
+    if (position != source_length)
+        return false;
+    return source || (!pending_read && buffers[upload_index].state == BUFFER_STATE_IDLE);
+}
+
+// fills the next unpack buffer (at most one per call)
+static void unpack_next() {
+    tBuffer *output = unpack_buffers + fill_index;
+    if (output->state == BUFFER_STATE_IDLE && !output->length)
+        output->position = unpacked;
+
+    while (output->state == BUFFER_STATE_IDLE && unpacked != current->length) {
+        uint32_t size = current->length - output->position;
+        if (size > BUFFER_SIZE)
+            size = BUFFER_SIZE;
+
+        // (repeated run may continue without any input)
+        bool run_pending = repeat_left && !repeat_value_pending;
+        if (source) {
+            if (position == source_length && !run_pending)
+                break;
+            position += unpack(source + current->source_addr + position, source_length - position, output, size);
+        } else {
+            tBuffer *input = buffers + upload_index;
+            if (input->state != BUFFER_STATE_READ) {
+                if (!run_pending)
+                    break;
+                unpack(input->buffer, 0, output, size);
+            } else {
+                input->consumed += unpack(input->buffer + input->consumed, input->length - input->consumed,
+                                          output, size);
+                if (input->consumed == input->length) {
+                    input->state = BUFFER_STATE_IDLE;
+                    upload_index = next_buffer(upload_index);
+                }
+            }
+        }
+        unpacked = output->position + output->length;
+
+        // full (or nothing more to unpack) -> ready for the upload (unless skipped)
+        if (output->length == size || (input_consumed() && output->length)) {
+            if (page_skipped(output->position)) {
+                output->position = unpacked;
+                output->length = 0;
+                break;
+            }
+            output->state = BUFFER_STATE_READ;
+            fill_index = next_unpack_buffer(fill_index);
+            break;
+        }
+    }
+}
 
-static tSPIFlashRequest read_request;
+#ifdef UPLOAD_CHAIN
+// *******************************************
+// **  CHAINED DMA                          **
+// *******************************************
+
+#ifndef UPLOAD_CHAIN_DESCRIPTORS
+#define UPLOAD_CHAIN_DESCRIPTORS 4
+#endif
+static tUploadDescriptor chain[UPLOAD_CHAIN_DESCRIPTORS];
+// next descriptor to queue & oldest queued one
+static unsigned chain_queue_index;
+static unsigned chain_done_index;
+// descriptors of a cancelled request may still be in flight
+static bool chain_draining;
+
+static inline unsigned next_descriptor(unsigned index) {
+    return (index + 1 == UPLOAD_CHAIN_DESCRIPTORS) ? 0 : index + 1;
+}
+
+static void chain_reset() {
+    memset(chain, 0, sizeof(chain));
+    chain_queue_index = 0;
+    chain_done_index = 0;
+    chain_draining = false;
+    upload_chain_init(chain, UPLOAD_CHAIN_DESCRIPTORS);
+}
+
+static inline bool chained() {
+    return current->uploadPrefixRoutine && !source && current->compression == RENDERER_COMPRESSION_NONE;
+}
+#endif
+
+// *******************************************
+// **  UPLOAD                               **
+// *******************************************
 
 void upload_data_init() {
+    unsigned i;
     current = 0;
-    bufferA.buffer = bufferA_data;
-    bufferB.buffer = bufferB_data;
+    pending_read = 0;
+    uploading = 0;
+    for (i = 0; i < UPLOAD_BUFFERS; i++) {
+        buffers[i].buffer = buffer_data[i];
+        buffers[i].state = BUFFER_STATE_IDLE;
+    }
+    unpack_reset();
+#ifdef UPLOAD_CHAIN
+    chain_reset();
+#endif
 }
 
 void upload_data_start(tUploadDataRequest *request) {
+    unsigned i;
     current = request;
     current->finished = false;
+    current->complete = false;
+    current->progress = 0;
+    current->duration = 0;
     position = 0;
+    start_time = TIME_GET;
+    source = request->source_data;
+    if (!source && scene_decoder_use_default())
+        source = renderer_data;
+    source_length = (request->compression == RENDERER_COMPRESSION_NONE) ? request->length : request->source_length;
+
+    for (i = 0; i < UPLOAD_BUFFERS; i++) {
+        buffers[i].position = 0;
+        buffers[i].state = BUFFER_STATE_IDLE;
+    }
+    read_index = 0;
+    upload_index = 0;
+    uploading = 0;
+    unpack_reset();
+    if (request->compression == RENDERER_COMPRESSION_NONE)
+        skip_pages();
+}
 
-    bufferA.position = 0;
-    bufferB.position = 0;
-    bufferA.state = BUFFER_STATE_IDLE;
-    bufferB.state = BUFFER_STATE_IDLE;
+void upload_data_cancel() {
+#ifdef UPLOAD_CHAIN
+    if (current && chained()) {
+        upload_chain_abort();
+        chain_draining = true;
+    }
+#endif
+    current = 0;
 }
 
 static inline void start_reading(tBuffer *buffer) {
     buffer->position = position;
-    buffer->length = current->length - position;
+    buffer->length = source_length - position;
     if (buffer->length > BUFFER_SIZE)
         buffer->length = BUFFER_SIZE;
+    buffer->consumed = 0;
     position += buffer->length;
+    if (current->compression == RENDERER_COMPRESSION_NONE)
+        skip_pages();
     buffer->state = BUFFER_STATE_READING;
 
-    read_request.buffer = buffer->buffer;
-    read_request.bank = FLASH_BANK_SCENE;
-    read_request.address = current->source_addr + buffer->position;
-    read_request.length = buffer->length;
-    if (scene_decoder_use_default()) {
-        memcpy(read_request.buffer, renderer_data + read_request.address, read_request.length);
-        read_request.status = SPI_FLASH_DONE;
-    } else {
-        spi_flash_read(&read_request);
+    tSPIFlashRequest *read_request = &buffer->read_request;
+    read_request->buffer = buffer->buffer;
+    read_request->bank = FLASH_BANK_SCENE;
+    read_request->address = current->source_addr + buffer->position;
+    read_request->length = buffer->length;
+    spi_flash_read(read_request);
+    pending_read = read_request;
+}
+
+static void finish() {
+    current->duration = TIME_GET - start_time;
+    if (current->duration)
+        TRACE("Upload finished (%d bytes in %d ms, %d kB/s)", current->length, current->duration,
+              current->length / current->duration)
+    current->complete = current->compression == RENDERER_COMPRESSION_NONE || unpacked == current->length;
+    if (!current->complete)
+        TRACE("Upload incomplete (%d of %d bytes unpacked)", unpacked, current->length)
+    current->finished = true;
+    current = 0;
+}
+
+// pages up to the next skipped one (at most limit bytes)
+static uint32_t next_chunk(uint32_t limit) {
+    uint32_t length = 0;
+    do {
+        length += BUFFER_SIZE;
+    } while (length < limit && position + length < current->length && !page_skipped(position + length));
+    if (length > current->length - position)
+        length = current->length - position;
+    return length;
+}
+
+static void upload_direct() {
+    // previous chunk uploaded?
+    if (!current->updateFinishedRoutine())
+        return;
+    current->progress = position;
+    if (position == current->length) {
+        finish();
+        return;
     }
+
+    uint32_t length = next_chunk(UPLOAD_DIRECT_CHUNK);
+    current->uploadDataRoutine((uint8_t *) source + current->source_addr + position,
+                               current->target_addr + position, length);
+    position += length;
+    skip_pages();
 }
 
+#ifdef UPLOAD_CHAIN
+// the DMA runs on its own, the main loop only refills the ring
+static void upload_chained() {
+    // done descriptors released in order
+    while (chain[chain_done_index].state == UPLOAD_DESCRIPTOR_DONE) {
+        tUploadDescriptor *descriptor = chain + chain_done_index;
+        current->progress = descriptor->target_addr - current->target_addr + descriptor->length;
+        descriptor->state = UPLOAD_DESCRIPTOR_FREE;
+        chain_done_index = next_descriptor(chain_done_index);
+    }
+
+    // queue the next chunks while the ring has room
+    bool queued = false;
+    while (position != current->length && chain[chain_queue_index].state == UPLOAD_DESCRIPTOR_FREE) {
+        tUploadDescriptor *descriptor = chain + chain_queue_index;
+        descriptor->length = next_chunk(UPLOAD_CHAIN_CHUNK);
+        descriptor->source_addr = current->source_addr + position;
+        descriptor->target_addr = current->target_addr + position;
+        descriptor->prefix_length = current->uploadPrefixRoutine(descriptor->target_addr, descriptor->prefix);
+        descriptor->state = UPLOAD_DESCRIPTOR_QUEUED;
+        chain_queue_index = next_descriptor(chain_queue_index);
+        position += descriptor->length;
+        skip_pages();
+        queued = true;
+    }
+    if (queued)
+        upload_chain_kick();
+
+    if (position == current->length && chain[chain_done_index].state == UPLOAD_DESCRIPTOR_FREE)
+        finish();
+}
+#endif
+
 bool upload_data_handle() {
+    // read finished?
+    if (pending_read && pending_read->status == SPI_FLASH_DONE) {
+        tBuffer *buffer = buffers + read_index;
+        pending_read = 0;
+        if (current && buffer->state == BUFFER_STATE_READING) {
+            buffer->state = BUFFER_STATE_READ;
+            read_index = next_buffer(read_index);
+        }
+    }
+
     if (!current)
         return false;
 
-    // finished?
-    if (bufferA.state == BUFFER_STATE_IDLE && position == current->length) {
-        current->finished = true;
-        current = 0;
+#ifdef UPLOAD_CHAIN
+    // cancelled chain stopped -> ring reused from its start
+    if (chain_draining) {
+        if (!upload_chain_idle())
+            return true;
+        chain_reset();
+    }
+    if (chained()) {
+        upload_chained();
         return true;
     }
+#endif
 
-    // initialize read on buffer A?
-    if (bufferA.state == BUFFER_STATE_IDLE && position != current->length) {
-        start_reading(&bufferA);
+    bool compressed = current->compression != RENDERER_COMPRESSION_NONE;
+    if (source && !compressed) {
+        upload_direct();
         return true;
     }
 
-    // initialize read on buffer B?
-//    if (bufferB.state == BUFFER_STATE_IDLE && bufferA.state != BUFFER_STATE_READING && position != current->length) {
-//        start_reading(&bufferB);
-//        return true;
-//    }
-
-    // read on buffer A finished?
-    if (bufferA.state == BUFFER_STATE_READING) {
-        if (read_request.status == SPI_FLASH_DONE) {
-            bufferA.state = BUFFER_STATE_READ;
-            return true;
-        }
+    // uploading finished? (unpack buffers are refilled from empty)
+    if (uploading && current->updateFinishedRoutine()) {
+        uploading->state = BUFFER_STATE_IDLE;
+        current->progress = uploading->position + uploading->length;
+        if (compressed)
+            uploading->length = 0;
+        uploading = 0;
     }
 
-    // read on buffer B finished?
-//    if (bufferB.state == BUFFER_STATE_READING) {
-//        if (read_request.status == SPI_FLASH_DONE) {
-//            bufferB.state = BUFFER_STATE_READ;
-//            return true;
-//        }
-//    }
-
-    // uploading finished?
-    if (bufferA.state == BUFFER_STATE_UPLOADING && current->updateFinishedRoutine()) {
-        bufferA.state = BUFFER_STATE_IDLE;
+    // upload next chunk (in order)?
+    tBuffer *buffer;
+    if (compressed) {
+        unpack_next();
+        buffer = unpack_buffers + unpack_upload_index;
+    } else {
+        buffer = buffers + upload_index;
     }
-//    if (bufferB.state == BUFFER_STATE_UPLOADING && current->updateFinishedRoutine()) {
-//        bufferB.state = BUFFER_STATE_IDLE;
-//    }
-
-    // upload buffer A?
-    if (bufferA.state == BUFFER_STATE_READ) {
-        current->uploadDataRoutine(bufferA.buffer, current->target_addr + bufferA.position, bufferA.length);
-        bufferA.state = BUFFER_STATE_UPLOADING;
+    if (!uploading && buffer->state == BUFFER_STATE_READ && current->updateFinishedRoutine()) {
+        current->uploadDataRoutine(buffer->buffer, current->target_addr + buffer->position, buffer->length);
+        buffer->state = BUFFER_STATE_UPLOADING;
+        uploading = buffer;
+        if (compressed)
+            unpack_upload_index = next_unpack_buffer(unpack_upload_index);
+        else
+            upload_index = next_buffer(upload_index);
     }
 
-//    // upload buffer B?
-//    if(bufferB.state==BUFFER_STATE_READ && bufferA.state!=BUFFER_STATE_UPLOADING) {
-//        current->uploadDataRoutine(bufferB.buffer, current->target_addr+bufferB.position, bufferB.length);
-//        bufferB.state=BUFFER_STATE_UPLOADING;
-//    }
-
+    // read next chunk while uploading?
+    buffer = buffers + read_index;
+    if (!source && !pending_read && position != source_length && buffer->state == BUFFER_STATE_IDLE)
+        start_reading(buffer);
 
+    // finished? (unpacking stops at the uploaded length, corrupted data with the input)
+    if (uploading || pending_read)
+        return true;
+    if (compressed) {
+        if ((unpacked == current->length || input_consumed())
+            && unpack_buffers[unpack_upload_index].state == BUFFER_STATE_IDLE)
+            finish();
+    } else if (input_consumed()) {
+        finish();
+    }
     return true;
 }
-
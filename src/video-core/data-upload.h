@@ -10,22 +10,48 @@
 
 typedef void (*rUploadDataRoutine)(uint8_t *data, uint32_t offset, uint32_t length);
 typedef bool (*rUpdateFinishedRoutine)();
+// writes the video core prefix of an upload to the target offset, returns its length
+typedef uint8_t (*rUploadPrefixRoutine)(uint32_t offset, uint8_t *prefix);
+
+#define UPLOAD_PREFIX_MAX   4
 
 typedef struct tagUploadDataRequest {
     rUploadDataRoutine uploadDataRoutine;
     rUpdateFinishedRoutine updateFinishedRoutine;
+    // uncompressed flash sources go through the chained DMA (UPLOAD_CHAIN)
+    // instead of the upload routine if set
+    rUploadPrefixRoutine uploadPrefixRoutine;
 
+    // addressable source (e.g. the FPGA bit-stream), NULL reads the scene
+    // flash (or the built-in scene), source_addr is added in both cases
+    const uint8_t *source_data;
     uint32_t source_addr;
     uint32_t target_addr;
+    // uploaded bytes
     uint32_t length;
-
+    // source compression (RENDERER_COMPRESSION_*) & source bytes if compressed
+    uint16_t compression;
+    uint32_t source_length;
+    // bitmap of the pages (RENDERER_BUNDLE_PAGE_SIZE) already at the target,
+    // not uploaded (nor read unless compressed), NULL uploads all
+    const uint32_t *skip_pages;
+
+    // bytes uploaded so far (from the start)
+    uint32_t progress;
+    // time the upload took (ms, set when finished)
+    uint32_t duration;
     bool finished;
+    // whole length uploaded (false if the compressed source ran out early)
+    bool complete;
 } tUploadDataRequest;
 
 void upload_data_init();
 
 void upload_data_start(tUploadDataRequest* request);
 
+// stops the current request (not marked as finished)
+void upload_data_cancel();
+
 bool upload_data_handle();
 
 #endif //HEAD_UNIT_DATA_UPLOAD_H
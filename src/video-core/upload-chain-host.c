@@ -0,0 +1,48 @@
+//
+// Host simulation of the chained DMA: the descriptors are read from the
+// flash stand-in and sent by the SPI stand-in when the simulation steps it
+//
+#include "upload-chain.h"
+#include "spi-flash.h"
+#include "spi-vc.h"
+
+static tUploadDescriptor *ring;
+static unsigned ring_count;
+static unsigned ring_index;
+static bool running;
+static uint8_t chunk[UPLOAD_CHAIN_CHUNK];
+
+void upload_chain_init(tUploadDescriptor *descriptors, unsigned count) {
+    ring = descriptors;
+    ring_count = count;
+    ring_index = 0;
+    running = false;
+}
+
+void upload_chain_kick() {
+    running = true;
+}
+
+void upload_chain_abort() {
+    running = false;
+}
+
+bool upload_chain_idle() {
+    return !running || ring[ring_index].state != UPLOAD_DESCRIPTOR_QUEUED;
+}
+
+bool upload_chain_host_transfer() {
+    if (!running)
+        return false;
+    tUploadDescriptor *descriptor = ring + ring_index;
+    // end of the chain -> stopped until kicked
+    if (descriptor->state != UPLOAD_DESCRIPTOR_QUEUED) {
+        running = false;
+        return false;
+    }
+    spi_flash_read_sync(FLASH_BANK_SCENE, descriptor->source_addr, chunk, descriptor->length);
+    spi_vc_send(descriptor->prefix, descriptor->prefix_length, chunk, descriptor->length);
+    descriptor->state = UPLOAD_DESCRIPTOR_DONE;
+    ring_index = (ring_index + 1 == ring_count) ? 0 : ring_index + 1;
+    return true;
+}
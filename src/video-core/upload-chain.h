@@ -0,0 +1,58 @@
+//
+// Chained flash -> video core DMA (UPLOAD_CHAIN)
+//
+
+#ifndef HEAD_UNIT_UPLOAD_CHAIN_H
+#define HEAD_UNIT_UPLOAD_CHAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "data-upload.h"
+
+// The driver walks the descriptor ring in order from the first descriptor:
+// every queued descriptor is read from the scene flash and sent to the video
+// core (after the prefix) without passing the data through the CPU, then
+// marked done (e.g. from the DMA interrupt). The DMA stops at the first
+// descriptor not queued and is restarted by upload_chain_kick(). The video
+// core SPI belongs to the driver (spi_vc_idle() false) while it runs.
+// upload-chain-host.c is the host simulation of the driver.
+
+#ifndef UPLOAD_CHAIN_CHUNK
+#define UPLOAD_CHAIN_CHUNK  (16*1024)
+#endif
+
+typedef enum tagUploadDescriptorState {
+    UPLOAD_DESCRIPTOR_FREE,
+    UPLOAD_DESCRIPTOR_QUEUED,
+    UPLOAD_DESCRIPTOR_DONE
+} eUploadDescriptorState;
+
+typedef struct tagUploadDescriptor {
+    // scene flash address & video core address (at most UPLOAD_CHAIN_CHUNK bytes)
+    uint32_t source_addr;
+    uint32_t target_addr;
+    uint32_t length;
+    uint8_t prefix[UPLOAD_PREFIX_MAX];
+    uint8_t prefix_length;
+    volatile eUploadDescriptorState state;
+} tUploadDescriptor;
+
+// (re)starts at the first descriptor of the ring, the DMA must be idle
+void upload_chain_init(tUploadDescriptor *ring, unsigned count);
+
+// descriptors queued -> DMA restarted if stopped
+void upload_chain_kick();
+
+// stops the DMA after the descriptor in flight (the rest is left queued)
+void upload_chain_abort();
+
+// nothing in flight
+bool upload_chain_idle();
+
+#ifndef PIC32
+// host simulation: transfers the next queued descriptor (the DMA completion),
+// false if the DMA is stopped
+bool upload_chain_host_transfer();
+#endif
+
+#endif //HEAD_UNIT_UPLOAD_CHAIN_H
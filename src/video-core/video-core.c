@@ -7,6 +7,10 @@
 #include <spi-vc.h>
 #include "trace.h"
 #include "data-upload.h"
+#include "memcpy.h"
+#ifndef PIC32
+#include <stdlib.h>
+#endif
 
 // *******************************************
 // **  VIDEO CORE POLL CONTEXT              **
@@ -16,6 +20,23 @@ static tTime next_poll_time;
 
 #define POLL_PERIOD_MS          10
 
+#ifdef VC_READY_IRQ
+// event driven rendering: the status is queried when the ready line of the
+// video core is raised (queue buffer freed, VSYNC), when a changed scene can
+// be sent and at the slow period (scrubbing, lost events)
+#ifndef VC_READY_POLL_PERIOD_MS
+#define VC_READY_POLL_PERIOD_MS 50
+#endif
+static volatile bool ready_event;
+// queue buffer free at the last status query
+static bool queue_free;
+#ifndef PIC32
+// host stand-in of the line: the simulated core executes the queue when it is
+// sent, the line is raised as soon as the interface is idle again
+static bool ready_line_armed;
+#endif
+#endif
+
 // *******************************************
 // **  MODE SELECTION CONTEXT               **
 // *******************************************
@@ -38,13 +59,53 @@ static tTime mode_switch_timeout;
 #define MODE_SWITCH_TIMEOUT     25
 static unsigned mode_switch_retry;
 
+// *******************************************
+// **  TEXTURE RESIDENCY CONTEXT            **
+// *******************************************
+
+// texture memory of the video core, bundles of several screens are kept
+// resident and the least recently used ones are evicted when short of memory
+#ifndef VC_TEXTURE_MEMORY
+#define VC_TEXTURE_MEMORY       (512*1024)
+#endif
+#define VC_TEXTURE_SLOTS        8
+// bundle pages match the texture memory pages
+#define VC_TEXTURE_ALIGNMENT    RENDERER_BUNDLE_PAGE_SIZE
+#define VC_TEXTURE_PAGES        (VC_TEXTURE_MEMORY / RENDERER_BUNDLE_PAGE_SIZE)
+
+typedef struct tTextureSlot {
+    bool resident;
+    bool uploaded;
+    uint32_t base;              // bundle address in the scene flash
+    uint32_t length;
+    uint32_t stored_length;     // bytes in the scene flash
+    uint16_t compression;
+    uint16_t first_page;        // page hashes (RENDERER_NULL_HANDLE: not hashed)
+    uint32_t offset;            // bundle address in the texture memory
+    uint32_t last_used;
+} tTextureSlot;
+
+static tTextureSlot texture_slots[VC_TEXTURE_SLOTS];
+static uint32_t texture_use_counter;
+
+// content of the texture memory pages (hash of the bundle page uploaded last),
+// pages with the same content are not uploaded again
+typedef struct tTexturePage {
+    bool valid;
+    uint16_t length;
+    uint32_t hash;
+} tTexturePage;
+
+static tTexturePage texture_pages[VC_TEXTURE_PAGES];
+static uint32_t texture_pages_skip[(VC_TEXTURE_PAGES + 31) / 32];
+
 // *******************************************
 // **  RENDERING CONTEXT                    **
 // *******************************************
 
 // update timer
 static tTime last_rendering;
-#define RENDERING_PERIOD        50
+#define RENDERING_PERIOD        20
 #define PLAYBACK_PERIOD         50
 
 //// data exchange buffer
@@ -54,8 +115,8 @@ static tTime last_rendering;
 
 // rendering textures
 static bool clear_screen;
-static tRendererScreenGraphics *current_rendering_context;
-static tRendererScreenGraphics *target_rendering_context;
+static tTextureSlot *current_rendering_context;
+static tTextureSlot *target_rendering_context;
 #define RENDER_STATE_START              0
 #define RENDER_STATE_CLEAR_SCREEN       1
 #define RENDER_STATE_CLEAR_SCREEN_WAIT  2
@@ -72,15 +133,15 @@ static tUploadDataRequest texture_request;
 //// -- texture buffer B
 //static tSPIFlashRequest texture_requestB;
 
-// video playback context
-static bool video_uploaded;
-static uint32_t video_upload_position;
+// video playback context (frames are streamed to the video memory start
+// while the frames already uploaded are played)
+static tUploadDataRequest video_request;
 static uint16_t video_frame;
 static tRendererVideoDescriptor *video_descriptor;
 static rRendererVideoCallback video_callback;
 static const void *video_callback_arg;
 
-void vc_cmd_rect_color(tRendererPosition left,
+bool vc_cmd_rect_color(tRendererPosition left,
                        tRendererPosition top,
                        tRendererPosition width,
                        tRendererPosition height,
@@ -89,6 +150,9 @@ void vc_cmd_rect_color(tRendererPosition left,
                        uint16_t max_length,
                        uint16_t *length);
 
+static void upload_data(uint8_t *data, uint32_t offset, uint32_t length);
+static uint8_t upload_prefix(uint32_t offset, uint8_t *prefix);
+
 // *******************************************
 // **  INITIALIZATION ROUTINE               **
 // *******************************************
@@ -98,6 +162,13 @@ void vc_init() {
 
     // initialize poll context
     next_poll_time = 0;
+#ifdef VC_READY_IRQ
+    ready_event = false;
+    queue_free = false;
+#ifndef PIC32
+    ready_line_armed = false;
+#endif
+#endif
 
     // reset mode context
     current_mode = DISPLAY_OFF;
@@ -112,8 +183,12 @@ void vc_init() {
     target_rendering_context = NULL;
     last_rendering = 0;
 
+    // nothing resident
+    memset(texture_slots, 0, sizeof(texture_slots));
+    texture_use_counter = 0;
+    memset(texture_pages, 0, sizeof(texture_pages));
+
     // reset playback context
-    video_uploaded = false;
     video_descriptor = NULL;
 
     // reset
@@ -121,27 +196,195 @@ void vc_init() {
     renderer_init();
 }
 
-void vc_set_render_mode(tRendererScreenGraphics *graphics) {
-    target_rendering_context = graphics;
+// *******************************************
+// **  TEXTURE RESIDENCY                    **
+// *******************************************
+
+static tTextureSlot *find_texture_slot(const tRendererScreenGraphics *graphics) {
+    unsigned i;
+    for (i = 0; i < VC_TEXTURE_SLOTS; i++) {
+        tTextureSlot *slot = texture_slots + i;
+        if (slot->resident && slot->base == graphics->base && slot->length == graphics->length)
+            return slot;
+    }
+    return NULL;
+}
+
+static void release_texture_slot(tTextureSlot *slot) {
+    slot->resident = false;
+    slot->uploaded = false;
+}
+
+// first gap (memory start or end of a resident bundle) the bundle fits in
+static bool find_texture_space(uint32_t length, uint32_t *offset) {
+    unsigned i, j;
+    for (i = 0; i <= VC_TEXTURE_SLOTS; i++) {
+        uint32_t candidate = 0;
+        if (i > 0) {
+            const tTextureSlot *slot = texture_slots + i - 1;
+            if (!slot->resident)
+                continue;
+            candidate = (slot->offset + slot->length + VC_TEXTURE_ALIGNMENT - 1) & ~(VC_TEXTURE_ALIGNMENT - 1);
+        }
+        if (candidate + length > VC_TEXTURE_MEMORY)
+            continue;
+        for (j = 0; j < VC_TEXTURE_SLOTS; j++) {
+            const tTextureSlot *slot = texture_slots + j;
+            if (slot->resident && candidate < slot->offset + slot->length && slot->offset < candidate + length)
+                break;
+        }
+        if (j == VC_TEXTURE_SLOTS) {
+            *offset = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static tTextureSlot *allocate_texture_slot(const tRendererScreenGraphics *graphics) {
+    uint32_t length = graphics->length;
+    if (length > VC_TEXTURE_MEMORY) {
+        TRACE("Texture bundle too large (%d bytes)", length)
+        length = VC_TEXTURE_MEMORY;
+    }
+
+    for (;;) {
+        tTextureSlot *free_slot = NULL;
+        tTextureSlot *lru_slot = NULL;
+        unsigned i;
+        for (i = 0; i < VC_TEXTURE_SLOTS; i++) {
+            tTextureSlot *slot = texture_slots + i;
+            if (!slot->resident) {
+                if (!free_slot)
+                    free_slot = slot;
+            } else if (!lru_slot || slot->last_used < lru_slot->last_used) {
+                lru_slot = slot;
+            }
+        }
+
+        uint32_t offset;
+        if (free_slot && find_texture_space(length, &offset)) {
+            free_slot->resident = true;
+            free_slot->uploaded = false;
+            free_slot->base = graphics->base;
+            free_slot->length = length;
+            free_slot->stored_length = graphics->stored_length;
+            free_slot->compression = graphics->compression;
+            free_slot->first_page = (length == graphics->length) ? graphics->first_page : RENDERER_NULL_HANDLE;
+            free_slot->offset = offset;
+            return free_slot;
+        }
+
+        // no space -> evict least recently used bundle (whole memory is free at the latest)
+        TRACE("Texture bundle evicted (%d bytes at %d)", lru_slot->length, lru_slot->offset)
+        release_texture_slot(lru_slot);
+    }
+}
+
+static inline uint16_t texture_page_length(const tTextureSlot *slot, unsigned page) {
+    uint32_t length = slot->length - page * RENDERER_BUNDLE_PAGE_SIZE;
+    return (length > RENDERER_BUNDLE_PAGE_SIZE) ? RENDERER_BUNDLE_PAGE_SIZE : length;
+}
+
+// pages of the bundle already in the texture memory, the rest is overwritten
+// by the upload (invalid until it finishes)
+static const uint32_t *texture_pages_resident(const tTextureSlot *slot, unsigned *resident) {
+    unsigned first = slot->offset / RENDERER_BUNDLE_PAGE_SIZE;
+    unsigned count = (slot->length + RENDERER_BUNDLE_PAGE_SIZE - 1) / RENDERER_BUNDLE_PAGE_SIZE;
+    unsigned i;
+    memset(texture_pages_skip, 0, sizeof(texture_pages_skip));
+    *resident = 0;
+    for (i = 0; i < count; i++) {
+        tTexturePage *page = texture_pages + first + i;
+        if (slot->first_page != RENDERER_NULL_HANDLE && page->valid
+            && page->hash == renderer_graphics_pages[slot->first_page + i]
+            && page->length == texture_page_length(slot, i)) {
+            renderer_bit_set(texture_pages_skip, i, true);
+            (*resident)++;
+        } else {
+            page->valid = false;
+        }
+    }
+    return texture_pages_skip;
+}
+
+static void texture_pages_uploaded(const tTextureSlot *slot) {
+    if (slot->first_page == RENDERER_NULL_HANDLE)
+        return;
+    unsigned first = slot->offset / RENDERER_BUNDLE_PAGE_SIZE;
+    unsigned count = (slot->length + RENDERER_BUNDLE_PAGE_SIZE - 1) / RENDERER_BUNDLE_PAGE_SIZE;
+    unsigned i;
+    for (i = 0; i < count; i++) {
+        tTexturePage *page = texture_pages + first + i;
+        page->valid = true;
+        page->hash = renderer_graphics_pages[slot->first_page + i];
+        page->length = texture_page_length(slot, i);
+    }
+}
+
+uint32_t vc_set_render_mode(const tRendererScreenGraphics *graphics) {
+    // upload of another bundle not finished -> drop it
+    if (target_rendering_context && !target_rendering_context->uploaded
+        && target_rendering_context != find_texture_slot(graphics)) {
+        upload_data_cancel();
+        release_texture_slot(target_rendering_context);
+    }
+
+    tTextureSlot *slot = find_texture_slot(graphics);
+    if (!slot)
+        slot = allocate_texture_slot(graphics);
+    slot->last_used = ++texture_use_counter;
+
+    target_rendering_context = slot;
     render_state = clear_screen ? RENDER_STATE_CLEAR_SCREEN : RENDER_STATE_START;
     clear_screen = false;
     last_rendering = 0;
     target_mode = NORMAL;
+    return slot->offset;
 }
 
 void vc_set_playback_mode(tRendererVideoDescriptor *descriptor,
                           rRendererVideoCallback callback,
                           const void *callback_arg) {
     video_descriptor = descriptor;
-    video_uploaded = false;
     video_frame = 0;
-    video_upload_position = 0;
     video_callback = callback;
     video_callback_arg = callback_arg;
 
+    // frames overwrite the textures
+    upload_data_cancel();
+    unsigned i;
+    for (i = 0; i < VC_TEXTURE_SLOTS; i++)
+        release_texture_slot(texture_slots + i);
+    memset(texture_pages, 0, sizeof(texture_pages));
+    current_rendering_context = NULL;
+    target_rendering_context = NULL;
+
+    // start streaming the frames
+    video_request.uploadDataRoutine = upload_data;
+    video_request.updateFinishedRoutine = spi_vc_idle;
+    video_request.uploadPrefixRoutine = upload_prefix;
+    video_request.source_data = NULL;
+    video_request.source_addr = descriptor->base;
+    video_request.target_addr = 0;
+    video_request.length = descriptor->length;
+    video_request.compression = RENDERER_COMPRESSION_NONE;
+    video_request.skip_pages = NULL;
+    TRACE("Video upload (%d bytes)", video_request.length)
+    upload_data_start(&video_request);
+
     target_mode = VIDEO;
 }
 
+// frame data uploaded (frame ends where the next one starts)
+static bool video_frame_resident(uint16_t frame) {
+    if (video_request.finished)
+        return true;
+    uint32_t end = (frame + 1 < video_descriptor->frame_count)
+                   ? video_descriptor->frame_offsets[frame + 1] : video_descriptor->length;
+    return video_request.progress >= end;
+}
+
 void vc_set_display_off() {
     target_mode = DISPLAY_OFF;
 }
@@ -153,6 +396,22 @@ void vc_set_display_off() {
 #define MAX_QUEUE_LENGTH        (16*1024)
 static uint8_t command_queue[MAX_QUEUE_LENGTH];
 
+#ifdef VC_READY_IRQ
+void vc_ready_interrupt() {
+    ready_event = true;
+}
+#endif
+
+// command queue sent (buffer taken)
+static inline void queue_sent() {
+#ifdef VC_READY_IRQ
+    queue_free = false;
+#ifndef PIC32
+    ready_line_armed = true;
+#endif
+#endif
+}
+
 static uint8_t query_status_buffer[3];
 
 static uint8_t query_status() {
@@ -175,16 +434,21 @@ static void set_mode(uint8_t mode) {
     spi_vc_exchange(set_mode_buffer, NULL, 2);
 }
 
-static uint8_t upload_data_buffer[4];
+static uint8_t upload_data_buffer[UPLOAD_PREFIX_MAX];
+
+// prefix of the data uploads (also queued with the chained DMA descriptors)
+static uint8_t upload_prefix(uint32_t offset, uint8_t *prefix) {
+    prefix[0] = 0x02;
+    prefix[1] = (offset >> 16) & 0xff;
+    prefix[2] = (offset >> 8) & 0xff;
+    prefix[3] = (offset >> 0) & 0xff;
+    return 4;
+}
 
 static void upload_data(uint8_t *data, uint32_t offset, uint32_t length) {
     if (!spi_vc_idle())
         return;
-    upload_data_buffer[0] = 0x02;
-    upload_data_buffer[1] = (offset >> 16) & 0xff;
-    upload_data_buffer[2] = (offset >> 8) & 0xff;
-    upload_data_buffer[3] = (offset >> 0) & 0xff;
-    spi_vc_send(upload_data_buffer, 4, data, length);
+    spi_vc_send(upload_data_buffer, upload_prefix(offset, upload_data_buffer), data, length);
 }
 
 static uint8_t set_video_frame_buffer[4];
@@ -229,45 +493,17 @@ static eStatus handle_mode(uint8_t status) {
 
         // 1st frame address not sent?
         if (video_frame == 0) {
+            // wait for the frame data only (rest is uploaded during the playback)
+            if (!video_frame_resident(0))
+                return RETURN_FALSE;
             // send frame
             set_video_frame();
             video_frame++;
+            mode_switch_timeout = 0;
             return RETURN_TRUE;
         }
 
-        // video content uploaded?
-        // TODO: implement FLASH reading
-        /*
-        if (!video_uploaded) {
-            static int content_handle = -1;
-            if (content_handle == -1) {
-                content_handle = open("impl1/texture-intro.bin", O_RDONLY);
-                if (content_handle < 0) {
-                    perror("VideoContent load");
-                    exit(1);
-                }
-                video_upload_position = 0;
-                TRACE("Video content upload started")
-            }
-            int len = read(content_handle, data_bufferA, BUFFER_SIZE);
-            if (len < 0) {
-                perror("VideoContent load");
-                exit(1);
-            }
-            if (len > 0) {
-                upload_data(data_bufferA, video_upload_position, len);
-                video_upload_position += len;
-                return RETURN_TRUE;
-            } else {
-                TRACE("Video content upload finished")
-                video_uploaded = true;
-                mode_switch_timeout = 0;
-                return RETURN_TRUE;
-            }
-        }
-         */
-
-        // VIDEO CONTENT IS UPLOADED
+        // 1ST FRAME IS UPLOADED
         last_rendering = TIME_GET;
 
         if (mode_switch_timeout == 0) {
@@ -313,21 +549,30 @@ static eStatus handle_mode(uint8_t status) {
 
 static eStatus handle_rendering(uint8_t status) {
     if (render_state == RENDER_STATE_START) {
-        // no need to upload texture?
-        if (current_rendering_context == target_rendering_context) {
-            // no -> start rendering scene
+        // no texture bundle (after video playback) -> wait for the screen
+        if (!target_rendering_context)
+            return RETURN_FALSE;
+        current_rendering_context = target_rendering_context;
+        // texture bundle resident?
+        if (current_rendering_context->uploaded) {
+            // yes -> start rendering scene
             render_state = RENDER_STATE_RENDERING;
             return RETURN_TRUE;
         }
         // upload texture
-        current_rendering_context = target_rendering_context;
         texture_request.uploadDataRoutine = upload_data;
         texture_request.updateFinishedRoutine = spi_vc_idle;
+        texture_request.uploadPrefixRoutine = upload_prefix;
+        texture_request.source_data = NULL;
         texture_request.source_addr = current_rendering_context->base;
-        texture_request.target_addr = 0;
+        texture_request.target_addr = current_rendering_context->offset;
         texture_request.length = current_rendering_context->length;
+        texture_request.compression = current_rendering_context->compression;
+        texture_request.source_length = current_rendering_context->stored_length;
+        unsigned resident;
+        texture_request.skip_pages = texture_pages_resident(current_rendering_context, &resident);
         render_state = RENDER_STATE_UPLOAD_TEXTURE;
-        TRACE("Texture upload (%d bytes)", texture_request.length)
+        TRACE("Texture upload (%d bytes, %d pages resident)", texture_request.length, resident)
         upload_data_start(&texture_request);
         return RETURN_TRUE;
     }
@@ -343,6 +588,7 @@ static eStatus handle_rendering(uint8_t status) {
             vc_cmd_rect_color(0, 0, 1024, 600, color, command_queue, MAX_QUEUE_LENGTH, &size);
             uint8_t prefix[1] = {0x01};
             spi_vc_send(prefix, 1, command_queue, size);
+            queue_sent();
             render_state=RENDER_STATE_CLEAR_SCREEN_WAIT;
             TRACE("Initial screen clearing")
             return RETURN_TRUE;
@@ -363,12 +609,19 @@ static eStatus handle_rendering(uint8_t status) {
     if (render_state == RENDER_STATE_UPLOAD_TEXTURE) {
         if (!texture_request.finished)
             return RETURN_FALSE;
+        current_rendering_context->uploaded = true;
+        // truncated bundle -> pages not trusted by the next upload
+        if (texture_request.complete)
+            texture_pages_uploaded(current_rendering_context);
         TRACE("Rendering started")
         render_state = RENDER_STATE_RENDERING;
     }
 
-    if (last_rendering + RENDERING_PERIOD > TIME_GET)
+#ifndef VC_READY_IRQ
+    // rest of split frame is sent as soon as the buffers are free
+    if (last_rendering + RENDERING_PERIOD > TIME_GET && !renderer_frame_pending())
         return RETURN_FALSE;
+#endif
 
     if (status & 0x02) {
         uint16_t size = 0;
@@ -379,6 +632,7 @@ static eStatus handle_rendering(uint8_t status) {
         if (size) {
             uint8_t prefix[1] = {0x01};
             spi_vc_send(prefix, 1, command_queue, size);
+            queue_sent();
             last_rendering = TIME_GET;
             return RETURN_TRUE;
         }
@@ -395,6 +649,7 @@ static eStatus handle_playback(uint8_t status) {
 
     if (video_frame >= video_descriptor->frame_count) {
         TRACE("Video playback finished")
+        upload_data_cancel();
 
         // switch off
         vc_set_display_off();
@@ -406,6 +661,10 @@ static eStatus handle_playback(uint8_t status) {
         return RETURN_FALSE;
     }
 
+    // frame not uploaded yet -> hold the previous one
+    if (!video_frame_resident(video_frame))
+        return RETURN_FALSE;
+
     // render
     static uint8_t frame[4];
     frame[0] = 0x03;
@@ -419,17 +678,44 @@ static eStatus handle_playback(uint8_t status) {
     return RETURN_TRUE;
 }
 
+static inline bool rendering_steady() {
+    return current_mode == NORMAL && target_mode == NORMAL && render_state == RENDER_STATE_RENDERING;
+}
+
+static bool poll_due() {
+#ifdef VC_READY_IRQ
+#ifndef PIC32
+    if (ready_line_armed) {
+        ready_line_armed = false;
+        ready_event = true;
+    }
+#endif
+    // steady rendering -> driven by the ready line & scene changes
+    if (rendering_steady() && (ready_event || (queue_free && (renderer_tiles_dirty || renderer_frame_pending()))))
+        return true;
+#endif
+    return next_poll_time <= TIME_GET;
+}
+
 bool vc_handle() {
+    // flash reads continue while the video core interface is busy
+    upload_data_handle();
     if (!spi_vc_idle())
         return false;
-    upload_data_handle();
     // polling?
-    if (next_poll_time > TIME_GET)
+    if (!poll_due())
         return false;
 
-    // poll status
+    // poll status (line raised again by events after the query)
+#ifdef VC_READY_IRQ
+    ready_event = false;
+    next_poll_time = TIME_GET + (rendering_steady() ? VC_READY_POLL_PERIOD_MS : POLL_PERIOD_MS);
+    uint8_t status = query_status();
+    queue_free = status & 0x02;
+#else
     next_poll_time = TIME_GET + POLL_PERIOD_MS;
     uint8_t status = query_status();
+#endif
 
     // TODO: check if status is valid
 #ifndef PIC32
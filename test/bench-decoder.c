@@ -0,0 +1,63 @@
+// scene decoding benchmark: synthetic stream & direct images of 10k+ tiles are
+// decoded from the flash stand-in (built with RENDERER_MAX_TILES raised)
+// usage: bench-decoder [repetitions]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "renderer-definition.h"
+#include "scene-decoder.h"
+#include "spi-flash.h"
+#include "test-scene.h"
+
+#define IMAGE_SIZE                      (1024 * 1024)
+#define MEMORY_SIZE                     (2 * 1024 * 1024)
+
+static double now_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+static bool bench(const char *name, uint8_t *image, uint32_t length, unsigned tiles, unsigned repetitions) {
+    test_flash = image;
+    test_flash_length = length;
+    unsigned i;
+    double start = now_us();
+    for (i = 0; i < repetitions; i++) {
+        if (!scene_decoder_decode(true) || scene_decoder_use_default() || renderer_tiles_count != tiles) {
+            printf("%s: not decoded\n", name);
+            return false;
+        }
+    }
+    double duration = (now_us() - start) / repetitions;
+    tSceneDecoderMemory memory;
+    scene_decoder_get_memory(&memory);
+    printf("%-8s %6d tiles %8d bytes %10.1f us/decode %8.1f ns/tile %8d bytes of memory\n", name, tiles, length,
+           duration, duration * 1e3 / tiles, memory.used);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    unsigned repetitions = (argc > 1) ? atoi(argv[1]) : 50;
+    static const unsigned sizes[] = {10000, 16000};
+    uint8_t *stream_image = malloc(IMAGE_SIZE);
+    uint8_t *direct_image = malloc(IMAGE_SIZE);
+    void *memory = aligned_alloc(8, MEMORY_SIZE);
+    if (!stream_image || !direct_image || !memory || !repetitions)
+        return 2;
+    scene_decoder_set_memory(memory, MEMORY_SIZE);
+
+    unsigned i;
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        tTestScene scene = {sizes[i], 4, 40, i + 1};
+        if (scene.tiles > RENDERER_MAX_TILES)
+            return 2;
+        uint32_t length = test_scene_stream(&scene, stream_image, IMAGE_SIZE);
+        if (!length || !bench("stream", stream_image, length, scene.tiles, repetitions))
+            return 1;
+        length = test_scene_direct(direct_image, IMAGE_SIZE);
+        if (!length || !bench("direct", direct_image, length, scene.tiles, repetitions))
+            return 1;
+    }
+    return 0;
+}
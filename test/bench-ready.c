@@ -0,0 +1,99 @@
+// rendering latency driven by the ready line (VC_READY_IRQ) or by the status
+// polling: the simulated video core keeps the queue buffer locked for 5 ms
+// after a queue is received and raises the line when it is free again (and on
+// VSYNC), the scene changes at random times of a main loop stepped every
+// 0.1 ms and the time until the change is sent is averaged
+// usage: bench-ready [limit] fails when the average exceeds the limit (ms)
+#include <stdio.h>
+#include <stdlib.h>
+#include "profile.h"
+#include "renderer.h"
+#include "renderer-scene.h"
+#include "scene-decoder.h"
+#include "spi-vc.h"
+#include "test-scene.h"
+#include "video-core.h"
+
+#define TICKS_PER_MS                    10
+#define BUFFER_LOCK_TICKS               (5 * TICKS_PER_MS)
+#define VSYNC_TICKS                     167
+#define WARM_UP_TICKS                   (1000 * TICKS_PER_MS)
+#define CHANGES                         500
+#define CHANGE_PERIOD_TICKS             (40 * TICKS_PER_MS)
+#define TICKS_MAX                       (WARM_UP_TICKS + CHANGES * (CHANGE_PERIOD_TICKS + 1000 * TICKS_PER_MS))
+
+extern tRendererTileHandle root_tile;
+
+static unsigned tick;
+static uint8_t core_mode;
+static unsigned buffer_free_tick;
+static unsigned queues;
+
+// status query & mode switch (immediate)
+static void core_exchange(uint8_t *tx, uint8_t *rx, uint32_t length) {
+    if (tx[0] == 4)
+        core_mode = tx[1];
+    else if (tx[0] == 0 && rx && length == 3)
+        rx[2] = 0x80 | (core_mode << 2) | ((tick >= buffer_free_tick) ? 0x02 : 0);
+}
+
+static void core_receive(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length) {
+    if (prefix_length == 1 && prefix[0] == 0x01) {
+        buffer_free_tick = tick + BUFFER_LOCK_TICKS;
+        queues++;
+    }
+}
+
+int main(int argc, char **argv) {
+    double limit = (argc > 1) ? atof(argv[1]) : 0;
+    test_vc_exchange = core_exchange;
+    test_vc_sink = core_receive;
+    test_random_seed(25);
+
+    vc_init();
+    if (!scene_decoder_decode(false)) {
+        printf("Built-in scene not decoded\n");
+        return 2;
+    }
+    renderer_show_screen(0);
+
+    unsigned changes = 0, change_tick = 0, change_queues = 0, next_change = WARM_UP_TICKS;
+    bool waiting = false;
+    uint64_t latency = 0;
+    for (tick = 0; changes < CHANGES; tick++) {
+        if (tick == TICKS_MAX) {
+            printf("Changes not sent (%d of %d)\n", changes, CHANGES);
+            return 1;
+        }
+        test_time = tick / TICKS_PER_MS;
+#ifdef VC_READY_IRQ
+        if (tick == buffer_free_tick || tick % VSYNC_TICKS == 0)
+            vc_ready_interrupt();
+#endif
+        if (!waiting && tick >= next_change && root_tile != RENDERER_NULL_HANDLE) {
+            renderer_set_color(root_tile, changes & 1);
+            waiting = true;
+            change_tick = tick;
+            change_queues = queues;
+        }
+
+        vc_handle();
+
+        // change sent with the frame started after it
+        if (waiting && queues != change_queues && !renderer_tiles_dirty) {
+            latency += tick - change_tick;
+            changes++;
+            waiting = false;
+            next_change = tick + 1 + test_random(CHANGE_PERIOD_TICKS);
+        }
+    }
+
+    double average = (double) latency / changes / TICKS_PER_MS;
+#ifdef VC_READY_IRQ
+    printf("ready line: ");
+#else
+    printf("polling: ");
+#endif
+    printf("%d changes, %.2f ms from a change to its queue on average\n", changes, average);
+    return (limit && average > limit) ? 1 : 0;
+}
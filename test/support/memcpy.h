@@ -0,0 +1,7 @@
+// host stand-in of the platform memory routines
+#ifndef RENDERER_TEST_MEMCPY_H
+#define RENDERER_TEST_MEMCPY_H
+
+#include <string.h>
+
+#endif //RENDERER_TEST_MEMCPY_H
@@ -0,0 +1,12 @@
+// host stand-in of the platform timer (time driven by the test)
+#ifndef RENDERER_TEST_PROFILE_H
+#define RENDERER_TEST_PROFILE_H
+
+#include <stdint.h>
+
+typedef uint32_t tTime;
+
+extern tTime test_time;
+#define TIME_GET                        test_time
+
+#endif //RENDERER_TEST_PROFILE_H
@@ -0,0 +1,32 @@
+// host stand-in of the platform SPI flash driver (test_flash is the flash content)
+#ifndef RENDERER_TEST_SPI_FLASH_H
+#define RENDERER_TEST_SPI_FLASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum eFlashBank {
+    FLASH_BANK_SCENE
+} tFlashBank;
+
+typedef enum eSPIFlashStatus {
+    SPI_FLASH_PENDING,
+    SPI_FLASH_DONE
+} tSPIFlashStatus;
+
+typedef struct tSPIFlashRequest {
+    uint8_t *buffer;
+    tFlashBank bank;
+    uint32_t address;
+    uint32_t length;
+    volatile tSPIFlashStatus status;
+} tSPIFlashRequest;
+
+extern uint8_t *test_flash;
+extern uint32_t test_flash_length;
+
+// completes immediately
+void spi_flash_read(tSPIFlashRequest *request);
+bool spi_flash_read_sync(tFlashBank bank, uint32_t address, void *data, uint32_t length);
+
+#endif //RENDERER_TEST_SPI_FLASH_H
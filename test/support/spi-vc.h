@@ -0,0 +1,16 @@
+// host stand-in of the platform video core SPI driver (transfers are dropped
+// and zeros received unless the test hooks are set)
+#ifndef RENDERER_TEST_SPI_VC_H
+#define RENDERER_TEST_SPI_VC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool spi_vc_idle(void);
+void spi_vc_send(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length);
+void spi_vc_exchange(uint8_t *tx, uint8_t *rx, uint32_t length);
+
+extern void (*test_vc_sink)(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length);
+extern void (*test_vc_exchange)(uint8_t *tx, uint8_t *rx, uint32_t length);
+
+#endif //RENDERER_TEST_SPI_VC_H
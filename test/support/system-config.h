@@ -0,0 +1,5 @@
+// host stand-in of the platform configuration (defaults of the modules are used)
+#ifndef RENDERER_TEST_SYSTEM_CONFIG_H
+#define RENDERER_TEST_SYSTEM_CONFIG_H
+
+#endif //RENDERER_TEST_SYSTEM_CONFIG_H
@@ -0,0 +1,51 @@
+// host stand-ins of the platform drivers
+#include <string.h>
+#include "profile.h"
+#include "trace.h"
+#include "spi-flash.h"
+#include "spi-vc.h"
+
+tTime test_time;
+bool test_trace;
+
+uint8_t *test_flash;
+uint32_t test_flash_length;
+
+void (*test_vc_sink)(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length);
+void (*test_vc_exchange)(uint8_t *tx, uint8_t *rx, uint32_t length);
+
+// reads behind the flash content return erased bytes
+static void flash_copy(uint32_t address, uint8_t *data, uint32_t length) {
+    memset(data, 0xff, length);
+    if (address >= test_flash_length)
+        return;
+    if (length > test_flash_length - address)
+        length = test_flash_length - address;
+    memcpy(data, test_flash + address, length);
+}
+
+void spi_flash_read(tSPIFlashRequest *request) {
+    flash_copy(request->address, request->buffer, request->length);
+    request->status = SPI_FLASH_DONE;
+}
+
+bool spi_flash_read_sync(tFlashBank bank, uint32_t address, void *data, uint32_t length) {
+    flash_copy(address, data, length);
+    return true;
+}
+
+bool spi_vc_idle(void) {
+    return true;
+}
+
+void spi_vc_send(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length) {
+    if (test_vc_sink)
+        test_vc_sink(prefix, prefix_length, data, length);
+}
+
+void spi_vc_exchange(uint8_t *tx, uint8_t *rx, uint32_t length) {
+    if (test_vc_exchange)
+        test_vc_exchange(tx, rx, length);
+    else if (rx)
+        memset(rx, 0, length);
+}
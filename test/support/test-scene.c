@@ -0,0 +1,303 @@
+// scene image writers for the host tests (see decode_* of the scene decoder)
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "renderer-definition.h"
+#include "scene-format.h"
+#include "crc32.h"
+#include "test-scene.h"
+
+#define SCREEN_WIDTH                    800
+#define SCREEN_HEIGHT                   480
+
+static uint32_t random_state;
+
+void test_random_seed(unsigned seed) {
+    random_state = seed * 2654435761u + 1;
+}
+
+uint32_t test_random(uint32_t range) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return range ? random_state % range : 0;
+}
+
+typedef struct tWriter {
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t length;
+} tWriter;
+
+static void put8(tWriter *writer, uint8_t value) {
+    if (writer->length < writer->capacity)
+        writer->data[writer->length] = value;
+    writer->length++;
+}
+
+static void put16(tWriter *writer, uint16_t value) {
+    put8(writer, value);
+    put8(writer, value >> 8);
+}
+
+static void put32(tWriter *writer, uint32_t value) {
+    put16(writer, value);
+    put16(writer, value >> 16);
+}
+
+static inline unsigned screen_first(const tTestScene *scene, unsigned screen) {
+    return screen * scene->tiles / scene->screens;
+}
+
+uint32_t test_scene_stream(const tTestScene *scene, uint8_t *image, uint32_t capacity) {
+    tWriter writer = {image, capacity, 0};
+    unsigned tiles = scene->tiles, i, j, s;
+    uint16_t *parent = malloc(tiles * sizeof(uint16_t));
+    uint16_t *root = malloc(tiles * sizeof(uint16_t));
+    uint16_t *children_count = calloc(tiles, sizeof(uint16_t));
+    uint16_t *children_first = malloc(tiles * sizeof(uint16_t));
+    uint16_t *child_index = malloc(tiles * sizeof(uint16_t));
+    bool *text_tile = calloc(tiles, sizeof(bool));
+    if (!parent || !root || !children_count || !children_first || !child_index || !text_tile)
+        abort();
+    test_random_seed(scene->seed);
+
+    // tile trees (parent precedes its children, texts take the last tiles of the screens)
+    unsigned texts_per_screen = (scene->texts + scene->screens - 1) / scene->screens;
+    for (s = 0; s < scene->screens; s++) {
+        unsigned first = screen_first(scene, s), end = screen_first(scene, s + 1);
+        unsigned text_first = end - texts_per_screen * TEST_SCENE_TEXT_LENGTH;
+        for (i = first; i < end; i++) {
+            root[i] = first;
+            text_tile[i] = i >= text_first && i != first;
+            if (i == first)
+                parent[i] = 0xffff;
+            else if (i >= text_first)
+                parent[i] = first;
+            else
+                parent[i] = first + test_random(i - first);
+        }
+    }
+    unsigned children = 0;
+    for (i = 0; i < tiles; i++) {
+        children_first[i] = children;
+        for (j = i + 1; j < tiles && root[j] == root[i]; j++) {
+            if (parent[j] == i) {
+                child_index[children++] = j;
+                children_count[i]++;
+            }
+        }
+    }
+
+    // header, length is filled at the end
+    put32(&writer, 0xDEADBEEF);
+    put32(&writer, 0);
+
+    // colors
+    put16(&writer, TEST_SCENE_COLORS);
+    for (i = 0; i < TEST_SCENE_COLORS; i++)
+        put16(&writer, test_random(0x10000) | ((i & 1) ? 0x000f : 0));
+
+    // tiles
+    put16(&writer, tiles);
+    for (i = 0; i < tiles; i++) {
+        // (characters are alpha textures)
+        bool textured = test_random(3) == 0 || text_tile[i];
+        put16(&writer, root[i]);
+        put16(&writer, parent[i]);
+        put16(&writer, children_count[i]);
+        put16(&writer, children_first[i]);
+        if (parent[i] == 0xffff) {
+            put16(&writer, 0);
+            put16(&writer, 0);
+            put16(&writer, SCREEN_WIDTH);
+            put16(&writer, SCREEN_HEIGHT);
+        } else {
+            put16(&writer, test_random(SCREEN_WIDTH));
+            put16(&writer, test_random(SCREEN_HEIGHT));
+            put16(&writer, 1 + test_random(200));
+            put16(&writer, 1 + test_random(120));
+        }
+        put8(&writer, parent[i] == 0xffff || test_random(4) != 0);
+        put16(&writer, test_random(TEST_SCENE_COLORS));
+        put8(&writer, textured);
+        if (textured) {
+            put32(&writer, test_random(0x10000) << 1);
+            put16(&writer, 1 + test_random(100));
+            put8(&writer, test_random(2));
+        }
+    }
+
+    // screens
+    put16(&writer, scene->screens);
+    for (s = 0; s < scene->screens; s++) {
+        put16(&writer, screen_first(scene, s));
+        put16(&writer, s & 1);
+    }
+
+    // child index
+    put16(&writer, children);
+    for (i = 0; i < children; i++)
+        put16(&writer, child_index[i]);
+
+    // glyphs of the printable ASCII characters
+    put16(&writer, 95);
+    for (i = 0; i < 95; i++) {
+        put16(&writer, 0x20 + i);
+        put16(&writer, 6 + test_random(10));
+        put16(&writer, 12 + test_random(8));
+        put16(&writer, test_random(3));
+        put16(&writer, test_random(4));
+        put16(&writer, 8 + test_random(10));
+        put32(&writer, i * 256);
+        put16(&writer, 8);
+        put8(&writer, 1);
+    }
+
+    // single font
+    put16(&writer, 1);
+    put16(&writer, 95);
+    put16(&writer, 0);
+    put16(&writer, 8);
+
+    // texts
+    put16(&writer, scene->texts * TEST_SCENE_TEXT_LENGTH);
+    put16(&writer, scene->texts);
+    for (i = 0; i < scene->texts; i++) {
+        s = i % scene->screens;
+        unsigned tile = screen_first(scene, s + 1) - (i / scene->screens + 1) * TEST_SCENE_TEXT_LENGTH;
+        put16(&writer, TEST_SCENE_TEXT_LENGTH);
+        put16(&writer, tile);
+        put16(&writer, 0);
+        put16(&writer, test_random(SCREEN_WIDTH - 100));
+        put16(&writer, test_random(SCREEN_HEIGHT - 20));
+        put8(&writer, test_random(3));
+        put8(&writer, test_random(3));
+        for (j = 0; j < TEST_SCENE_TEXT_LENGTH; j++)
+            put16(&writer, 0);
+    }
+
+    // texture bundles
+    put16(&writer, 2);
+    for (i = 0; i < 2; i++) {
+        put32(&writer, i * 0x10000);
+        put32(&writer, 0x8000);
+    }
+
+    // no videos
+    put16(&writer, 0);
+
+    free(parent);
+    free(root);
+    free(children_count);
+    free(children_first);
+    free(child_index);
+    free(text_tile);
+
+    if (writer.length > capacity)
+        return 0;
+    uint32_t length = writer.length;
+    writer.length = 4;
+    put32(&writer, length);
+    return length;
+}
+
+// *******************************************
+// **  DIRECT IMAGE                         **
+// *******************************************
+
+static void put_section(tWriter *writer, tSceneHeader *header, eSceneSection section,
+                        const void *data, unsigned count, unsigned record_size) {
+    while (writer->length & 3)
+        put8(writer, 0);
+    tSceneSection *descriptor = header->section + section;
+    descriptor->offset = writer->length;
+    descriptor->count = count;
+    descriptor->record_size = record_size;
+    descriptor->crc = 0;
+    if (writer->length + count * record_size > writer->capacity) {
+        writer->length += count * record_size;
+        return;
+    }
+    if (count)
+        memcpy(writer->data + writer->length, data, count * record_size);
+    descriptor->crc = crc32_update(0, writer->data + writer->length, count * record_size);
+    writer->length += count * record_size;
+}
+
+uint32_t test_scene_direct(uint8_t *image, uint32_t capacity) {
+    tWriter writer = {image, capacity, sizeof(tSceneHeader)};
+    tSceneHeader header;
+    unsigned i, characters = 0;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCENE_MAGIC_DIRECT;
+    header.version = SCENE_DIRECT_VERSION;
+    header.section_count = SCENE_SECTION_COUNT;
+
+    tSceneTile *tiles = calloc(renderer_tiles_count + 1, sizeof(tSceneTile));
+    tSceneText *texts = calloc(renderer_texts_count + 1, sizeof(tSceneText));
+    uint16_t *text_characters = calloc(1, 2);
+    if (!tiles || !texts || !text_characters)
+        abort();
+    for (i = 0; i < renderer_tiles_count; i++) {
+        const tRendererTile *tile = renderer_tiles + i;
+        tiles[i].texture_base = tile->texture.base;
+        tiles[i].root_tile = tile->root_tile;
+        tiles[i].parent_tile = tile->parent_tile;
+        tiles[i].children_count = tile->children_count;
+        tiles[i].children_list_index = tile->children_list_index;
+        tiles[i].left = renderer_tile_rects[i].left;
+        tiles[i].top = renderer_tile_rects[i].top;
+        tiles[i].width = tile->position_width;
+        tiles[i].height = tile->position_height;
+        tiles[i].color_handle = tile->color_handle;
+        tiles[i].texture_stripe_length = tile->texture.stripe_length;
+        tiles[i].visible = renderer_bit_get(renderer_tile_visible, i);
+        tiles[i].type = tile->rendering_mode == ALPHA_TEXTURE;
+        tiles[i].texture_compression = tile->texture.packed_alpha;
+    }
+    for (i = 0; i < renderer_texts_count; i++) {
+        const tRendererText *text = renderer_texts + i;
+        text_characters = realloc(text_characters, (characters + text->tile_count + 1) * 2);
+        if (!text_characters)
+            abort();
+        memcpy(text_characters + characters, text->text, text->tile_count * 2);
+        texts[i].tile_count = text->tile_count;
+        texts[i].tile = text->tile;
+        texts[i].font = text->font;
+        texts[i].position_x = text->position_x;
+        texts[i].position_y = text->position_y;
+        texts[i].alignment_h = (text->alignment_h == TEXT_CENTER) ? 1 : (text->alignment_h == TEXT_RIGHT) ? 2 : 0;
+        texts[i].alignment_v = (text->alignment_v == TEXT_MIDDLE) ? 1 : (text->alignment_v == TEXT_BOTTOM) ? 2 : 0;
+        texts[i].first_character = characters;
+        characters += text->tile_count;
+    }
+
+    put_section(&writer, &header, SCENE_SECTION_COLORS, renderer_colors, renderer_colors_simple_count, 2);
+    put_section(&writer, &header, SCENE_SECTION_TILES, tiles, renderer_tiles_count, sizeof(tSceneTile));
+    put_section(&writer, &header, SCENE_SECTION_SCREENS, renderer_screens, renderer_screen_count,
+                sizeof(tRendererScreen));
+    put_section(&writer, &header, SCENE_SECTION_CHILD_INDEX, renderer_child_index, renderer_child_index_count,
+                sizeof(tRendererTileHandle));
+    put_section(&writer, &header, SCENE_SECTION_GLYPHS, renderer_font_glyphs, renderer_font_glyphs_count,
+                sizeof(tRendererFontGlyph));
+    put_section(&writer, &header, SCENE_SECTION_FONTS, renderer_fonts, renderer_fonts_count, sizeof(tRendererFont));
+    put_section(&writer, &header, SCENE_SECTION_TEXTS, texts, renderer_texts_count, sizeof(tSceneText));
+    put_section(&writer, &header, SCENE_SECTION_TEXT_CHARACTERS, text_characters, characters, 2);
+    put_section(&writer, &header, SCENE_SECTION_BUNDLES, renderer_graphics, renderer_graphics_count,
+                sizeof(tRendererScreenGraphics));
+    put_section(&writer, &header, SCENE_SECTION_VIDEOS, NULL, 0, sizeof(tSceneVideo));
+    put_section(&writer, &header, SCENE_SECTION_VIDEO_FRAMES, NULL, 0, 4);
+    put_section(&writer, &header, SCENE_SECTION_BUNDLE_PAGES, renderer_graphics_pages, renderer_graphics_pages_count,
+                4);
+    free(tiles);
+    free(texts);
+    free(text_characters);
+    if (writer.length > capacity)
+        return 0;
+
+    header.length = writer.length;
+    header.crc = crc32_update(0, (const uint8_t *) &header, sizeof(header) - 4);
+    memcpy(image, &header, sizeof(header));
+    return writer.length;
+}
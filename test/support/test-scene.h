@@ -0,0 +1,29 @@
+// synthetic scenes for the host tests
+#ifndef RENDERER_TEST_SCENE_H
+#define RENDERER_TEST_SCENE_H
+
+#include <stdint.h>
+
+typedef struct tTestScene {
+    unsigned tiles;
+    // tiles are split evenly into the screens, the first tile of each part is the root
+    unsigned screens;
+    // texts of 8 characters (ASCII font), placed at the end of the screens
+    unsigned texts;
+    unsigned seed;
+} tTestScene;
+
+#define TEST_SCENE_TEXT_LENGTH          8
+#define TEST_SCENE_COLORS               16
+
+// builds a stream image (random tile trees, positions & colors), returns its length (0 = no room)
+uint32_t test_scene_stream(const tTestScene *scene, uint8_t *image, uint32_t capacity);
+
+// builds a direct image of the decoded scene tables (texts included), returns its length
+uint32_t test_scene_direct(uint8_t *image, uint32_t capacity);
+
+// deterministic pseudo-random numbers
+void test_random_seed(unsigned seed);
+uint32_t test_random(uint32_t range);
+
+#endif //RENDERER_TEST_SCENE_H
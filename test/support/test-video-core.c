@@ -0,0 +1,11 @@
+// stand-in of the video core for the tests without the video core driver
+#include "renderer-definition.h"
+#include "video-core.h"
+
+uint32_t vc_set_render_mode(const tRendererScreenGraphics *graphics) {
+    return graphics->base;
+}
+
+void vc_set_playback_mode(tRendererVideoDescriptor *descriptor,
+                          rRendererVideoCallback callback, const void *callback_arg) {
+}
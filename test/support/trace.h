@@ -0,0 +1,13 @@
+// host stand-in of the platform trace (printed when test_trace is set, time included
+// like the platform one)
+#ifndef RENDERER_TEST_TRACE_H
+#define RENDERER_TEST_TRACE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "profile.h"
+
+extern bool test_trace;
+#define TRACE(...)                      { if (test_trace) { printf(__VA_ARGS__); printf("\n"); } }
+
+#endif //RENDERER_TEST_TRACE_H
@@ -0,0 +1,267 @@
+// command encoder cross-check: random rectangles & glyph runs are encoded by the
+// renderer (full, same-color relative, glyph & glyph batch commands), decoded by
+// the rasterizer model of CommandProcessor.v and compared with the encoded ones
+// frames split in the middle of a glyph batch have to parse back as well
+// usage: test-commands [<queue.hex> <commands.hex>] writes the vectors of
+// fpga/test/CommandProcessorTest.v
+#include <stdio.h>
+#include <stdlib.h>
+#include "rasterizer.h"
+#include "scene-decoder.h"
+#include "spi-flash.h"
+#include "test-scene.h"
+#include "../src/renderer-display.c"
+
+#define QUEUES                          120
+#define QUEUE_SIZE                      2048
+#define COMMANDS_MAX                    (QUEUES * QUEUE_SIZE / 5)
+
+static uint8_t queue[QUEUE_SIZE];
+static tRasterizerCommand expected[COMMANDS_MAX];
+static unsigned expected_count;
+static unsigned decoded_count;
+static unsigned failures;
+static FILE *queue_file;
+static FILE *commands_file;
+
+static uint8_t image[64 * 1024];
+static uint8_t scene_memory[64 * 1024] __attribute__((aligned(8)));
+
+static const tRendererColor palette[] = {
+        {0xff, 0x80, 0x10, 0xff},
+        {0x20, 0xe0, 0x40, 0x80},
+        {0x00, 0x00, 0xf0, 0x30},
+        {0xf0, 0xf0, 0xf0, 0xf0},
+};
+static const uint16_t stripes[] = {16, 300, 700};
+
+// channels as named in the FPGA design (the encoder sends blue as red)
+static void expect(tRendererPosition left, tRendererPosition top,
+                   tRendererPosition width, tRendererPosition height,
+                   tRendererColor color, const tRendererTexture *texture) {
+    tRasterizerCommand *command = expected + expected_count++;
+    command->x1 = left & 0x3ff;
+    command->y1 = top & 0x3ff;
+    command->x2 = (left + width - 1) & 0x3ff;
+    command->y2 = (top + height - 1) & 0x3ff;
+    command->red = color.blue >> 4;
+    command->green = color.green >> 4;
+    command->blue = color.red >> 4;
+    command->alpha = texture ? 0 : color.alpha >> 4;
+    command->textured = texture != NULL;
+    command->texture_packed = texture != NULL;
+    command->texture_copy = false;
+    command->texture_stripe = texture ? texture->stripe_length : 0;
+    command->texture_base = texture ? (texture->base + texture_offset) & 0xfffff : 0;
+}
+
+static void decoded(const tRasterizerCommand *command) {
+    unsigned i = decoded_count++;
+    const tRasterizerCommand *e = expected + i;
+    if (i >= expected_count
+        || command->x1 != e->x1 || command->y1 != e->y1 || command->x2 != e->x2 || command->y2 != e->y2
+        || command->textured != e->textured
+        || command->red != e->red || command->green != e->green || command->blue != e->blue
+        || command->alpha != e->alpha
+        || (e->textured && (command->texture_packed != e->texture_packed
+                            || command->texture_copy != e->texture_copy
+                            || command->texture_stripe != e->texture_stripe
+                            || command->texture_base != e->texture_base))) {
+        if (failures++ < 10)
+            printf("Command %d: decoded (%d,%d)-(%d,%d) differs\n", i, command->x1, command->y1,
+                   command->x2, command->y2);
+    }
+}
+
+// x1 y1 x2 y2 (10 bits) r g b a (4 bits) textured packed copy stripe (10 bits) base (20 bits)
+static void write_command(const tRasterizerCommand *c) {
+    fprintf(commands_file, "%03x%03x%03x%03x%x%x%x%x%x%x%x%03x%05x\n", c->x1, c->y1, c->x2, c->y2,
+            c->red, c->green, c->blue, c->alpha, c->textured, c->texture_packed, c->texture_copy,
+            c->texture_stripe, c->texture_base);
+}
+
+// returns false when the queue is full
+static bool encode_next(uint16_t *length, unsigned *run) {
+    static tRendererPosition left, top;
+    static tRendererColor color;
+    static tRendererTexture texture;
+
+    // glyph run continues (same stripe & color, next to the previous glyph)
+    bool glyph = *run > 0;
+    if (glyph) {
+        left += 4 + test_random(12);
+        top += test_random(9) - 4;
+    } else {
+        unsigned kind = test_random(4);
+        if (kind == 0) {
+            left = test_random(1024);
+            top = test_random(1024);
+        } else {
+            left += test_random(400) - 200;
+            top += test_random(400) - 200;
+        }
+        color = palette[test_random(sizeof(palette) / sizeof(palette[0]))];
+        texture.stripe_length = stripes[test_random(sizeof(stripes) / sizeof(stripes[0]))];
+        if (test_random(3) == 0)
+            *run = 1 + test_random(test_random(4) ? 6 : 300);
+    }
+    tRendererPosition width = 1 + test_random(glyph ? 16 : (test_random(2) ? 256 : 600));
+    tRendererPosition height = 1 + test_random(glyph ? 16 : (test_random(2) ? 256 : 600));
+    texture.base = test_random(0x40000);
+
+    bool encoded;
+    if (*run) {
+        encoded = vc_cmd_rect_texture(left, top, width, height, color, &texture, 0, 0,
+                                      queue, QUEUE_SIZE, length);
+        if (encoded)
+            expect(left, top, width, height, color, &texture);
+    } else {
+        encoded = vc_cmd_rect_color(left, top, width, height, color, queue, QUEUE_SIZE, length);
+        if (encoded)
+            expect(left, top, width, height, color, NULL);
+    }
+    if (encoded && *run)
+        (*run)--;
+    return encoded;
+}
+
+static void counted(const tRasterizerCommand *command) {
+    decoded_count++;
+}
+
+// areas of overlapping glyph pairs: every area starts with the glyph that ended
+// the previous one, queues of every size are cut at all positions of the batches
+static bool split_glyph_batches() {
+    tTestScene scene = {64, 1, 2, 5};
+    test_flash = image;
+    test_flash_length = test_scene_stream(&scene, image, sizeof(image));
+    scene_decoder_set_memory(scene_memory, sizeof(scene_memory));
+    renderer_init();
+    if (!scene_decoder_decode(true) || scene_decoder_use_default()) {
+        printf("Scene not decoded\n");
+        return false;
+    }
+    renderer_show_screen(0);
+
+    // text of one color below the screen (no tile under it)
+    tRendererText *text = renderer_texts;
+    text->position_x = 100;
+    text->position_y = 700;
+    text->alignment_h = TEXT_LEFT;
+    renderer_set_text(0, "ABCDEFGH");
+    unsigned i;
+    for (i = 0; i < text->tile_count; i++)
+        renderer_set_color(text->tile + i, 1);
+    uint16_t length;
+    do {
+        renderer_update_display(queue, QUEUE_SIZE, &length);
+    } while (renderer_frame_pending());
+
+    rasterizer_set_command_callback(counted);
+    uint16_t size;
+    unsigned queues = 0;
+    for (size = VC_CMD_RECT_TEXTURE_LENGTH; size < 120; size++) {
+        damage.count = 0;
+        for (i = 0; i + 1 < text->tile_count; i++) {
+            const tRendererRect *glyph = renderer_tile_rects + text->tile + i;
+            const tRendererRect *next = glyph + 1;
+            tRectangle *area = damage.area + damage.count++;
+            area->x1 = glyph->left < next->left ? glyph->left : next->left;
+            area->x2 = glyph->right > next->right ? glyph->right : next->right;
+            area->y1 = glyph->top < next->top ? glyph->top : next->top;
+            area->y2 = glyph->bottom > next->bottom ? glyph->bottom : next->bottom;
+        }
+        pending_area = 0;
+        while (renderer_frame_pending()) {
+            uint32_t commands = statistics.commands;
+            length = 0;
+            redraw_pending(queue, size, &length);
+            decoded_count = 0;
+            queues++;
+            if (!rasterizer_execute(queue, length) || decoded_count != statistics.commands - commands) {
+                printf("Queue of %d bytes: %d commands decoded, %d encoded\n", size, decoded_count,
+                       statistics.commands - commands);
+                return false;
+            }
+        }
+    }
+    printf("%d split queues parsed back\n", queues);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3) {
+        queue_file = fopen(argv[1], "w");
+        commands_file = fopen(argv[2], "w");
+        if (!queue_file || !commands_file) {
+            printf("Vector files not created\n");
+            return 2;
+        }
+    }
+
+    unsigned q, i, opcodes[4] = {0}, run = 0, batch_peak = 0;
+    test_random_seed(9);
+    texture_offset = 0x40;
+    rasterizer_init();
+    rasterizer_set_command_callback(decoded);
+    for (q = 0; q < QUEUES; q++) {
+        uint16_t length = 0;
+        unsigned first = expected_count;
+        while (encode_next(&length, &run));
+
+        // command starts (lengths checked by the decoding)
+        for (i = 0; i < length;) {
+            uint8_t opcode = queue[i] & 0x03;
+            opcodes[opcode]++;
+            if (opcode == VC_OP_RECT)
+                i += (queue[i + 6] & 0x01) ? VC_CMD_RECT_TEXTURE_LENGTH : VC_CMD_RECT_COLOR_LENGTH;
+            else if (opcode == VC_OP_RECT_SAME)
+                i += VC_CMD_RECT_SAME_LENGTH;
+            else if (opcode == VC_OP_GLYPH)
+                i += VC_CMD_GLYPH_LENGTH;
+            else {
+                if (queue[i + 1] + 1 > batch_peak)
+                    batch_peak = queue[i + 1] + 1;
+                i += 2 + (queue[i + 1] + 1) * VC_CMD_GLYPH_BODY_LENGTH;
+            }
+        }
+        if (i != length) {
+            printf("Queue %d: command lengths do not add up (%d of %d bytes)\n", q, i, length);
+            return 1;
+        }
+
+        decoded_count = first;
+        if (!rasterizer_execute(queue, length)) {
+            printf("Queue %d rejected\n", q);
+            return 1;
+        }
+        if (decoded_count != expected_count) {
+            printf("Queue %d: %d commands decoded, %d encoded\n", q, decoded_count - first,
+                   expected_count - first);
+            return 1;
+        }
+
+        if (queue_file) {
+            for (i = 0; i < length; i++)
+                fprintf(queue_file, "%03x\n", queue[i]);
+            fprintf(queue_file, "100\n");
+            for (i = first; i < expected_count; i++)
+                write_command(expected + i);
+        }
+    }
+    if (queue_file) {
+        fclose(queue_file);
+        fclose(commands_file);
+    }
+
+    if (!opcodes[VC_OP_RECT_SAME] || !opcodes[VC_OP_GLYPH] || !opcodes[VC_OP_GLYPHS] || batch_peak != 256) {
+        printf("Opcodes not covered (same %d, glyph %d, glyphs %d, longest batch %d)\n", opcodes[VC_OP_RECT_SAME],
+               opcodes[VC_OP_GLYPH], opcodes[VC_OP_GLYPHS], batch_peak);
+        return 1;
+    }
+    if (failures || !split_glyph_batches())
+        return 1;
+    printf("%d commands in %d queues (rect %d, same %d, glyph %d, glyphs %d)\n", expected_count, QUEUES,
+           opcodes[VC_OP_RECT], opcodes[VC_OP_RECT_SAME], opcodes[VC_OP_GLYPH], opcodes[VC_OP_GLYPHS]);
+    return 0;
+}
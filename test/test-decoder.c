@@ -0,0 +1,119 @@
+// incremental decoding of stream & direct images: text calls are harmless
+// before the decoding finishes, damaged images fall back to the built-in scene
+// and the renderer drops the screen shown from the damaged one
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "renderer.h"
+#include "renderer-definition.h"
+#include "renderer-scene.h"
+#include "scene-decoder.h"
+#include "scene-format.h"
+#include "spi-flash.h"
+#include "test-scene.h"
+
+static uint8_t stream_image[64 * 1024];
+static uint8_t direct_image[64 * 1024];
+static uint8_t scene_memory[64 * 1024] __attribute__((aligned(8)));
+static uint8_t queue[1024];
+
+extern tRendererTileHandle root_tile;
+
+static const tTestScene scene = {300, 2, 10, 7};
+static unsigned failures;
+
+#define CHECK(condition, ...)           { if (!(condition)) { printf(__VA_ARGS__); printf("\n"); failures++; } }
+
+static void use_image(uint8_t *image, uint32_t length) {
+    test_flash = image;
+    test_flash_length = length;
+}
+
+// text calls made between the decoding steps
+static void decode_incrementally(const char *name, unsigned texts) {
+    unsigned steps = 0;
+    CHECK(scene_decoder_start(true), "%s: not started", name)
+    while (scene_decoder_handle()) {
+        steps++;
+        eSceneDecoderStatus status = scene_decoder_status();
+        if (status != SCENE_DECODER_FINISHED)
+            CHECK(renderer_texts_count == 0, "%s: %d texts published in step %d", name, renderer_texts_count, steps)
+        unsigned i;
+        for (i = 0; i < texts; i++) {
+            renderer_set_text(i, "Test 42");
+            renderer_set_number(i, -1234, RENDERER_NUMBER_DECIMALS(1));
+        }
+    }
+    CHECK(scene_decoder_status() == SCENE_DECODER_FINISHED && !scene_decoder_use_default(),
+          "%s: not finished (status %d)", name, scene_decoder_status())
+    CHECK(renderer_texts_count == texts, "%s: %d texts published", name, renderer_texts_count)
+}
+
+// damaged section -> built-in scene
+static void decode_damaged(eSceneSection section) {
+    const tSceneHeader *header = (const tSceneHeader *) direct_image;
+    uint32_t offset = header->section[section].offset;
+    direct_image[offset] ^= 0x01;
+    bool decoded = scene_decoder_decode(true);
+    CHECK(decoded && scene_decoder_use_default() && renderer_tiles_count < scene.tiles,
+          "Section %d: damaged image not replaced by the built-in one", section)
+    direct_image[offset] ^= 0x01;
+}
+
+// screen shown as soon as it is ready, damaged texts found afterwards
+static void show_damaged() {
+    const tSceneHeader *header = (const tSceneHeader *) direct_image;
+    uint32_t offset = header->section[SCENE_SECTION_TEXTS].offset;
+    uint16_t length;
+    direct_image[offset] ^= 0x01;
+
+    renderer_init();
+    scene_decoder_start(true);
+    while (scene_decoder_status() == SCENE_DECODER_DECODING && scene_decoder_handle())
+        continue;
+    CHECK(scene_decoder_status() == SCENE_DECODER_SCREEN_READY, "Screen not ready (status %d)",
+          scene_decoder_status())
+    renderer_show_screen(1);
+    renderer_update_display(queue, sizeof(queue), &length);
+    CHECK(length && root_tile != RENDERER_NULL_HANDLE, "Screen not rendered")
+
+    // fallback -> nothing rendered until the built-in screen is shown
+    while (scene_decoder_status() == SCENE_DECODER_SCREEN_READY && scene_decoder_handle())
+        continue;
+    CHECK(scene_decoder_use_default(), "Damaged texts not detected")
+    CHECK(root_tile == RENDERER_NULL_HANDLE, "Screen of the damaged scene still shown")
+    renderer_update_display(queue, sizeof(queue), &length);
+    CHECK(!length && !renderer_frame_pending(), "Damaged scene rendered after the fallback")
+
+    while (scene_decoder_handle())
+        continue;
+    CHECK(scene_decoder_status() == SCENE_DECODER_FINISHED, "Built-in scene not decoded")
+    renderer_show_screen(0);
+    renderer_update_display(queue, sizeof(queue), &length);
+    CHECK(length, "Built-in screen not rendered")
+    direct_image[offset] ^= 0x01;
+}
+
+int main() {
+    scene_decoder_set_memory(scene_memory, sizeof(scene_memory));
+
+    uint32_t length = test_scene_stream(&scene, stream_image, sizeof(stream_image));
+    use_image(stream_image, length);
+    decode_incrementally("Stream", scene.texts);
+
+    length = test_scene_direct(direct_image, sizeof(direct_image));
+    CHECK(length, "Direct image not built")
+    use_image(direct_image, length);
+    decode_incrementally("Direct", scene.texts);
+    CHECK(renderer_tiles_count == scene.tiles, "Direct: %d tiles", renderer_tiles_count)
+
+    decode_damaged(SCENE_SECTION_TILES);
+    decode_damaged(SCENE_SECTION_TEXTS);
+    decode_damaged(SCENE_SECTION_GLYPHS);
+    show_damaged();
+
+    if (failures)
+        return 1;
+    printf("Decoder test passed\n");
+    return 0;
+}
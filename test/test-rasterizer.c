@@ -0,0 +1,165 @@
+// rasterizer golden image: a fixed command queue covering every opcode and
+// rendering mode is executed and the dumped image compared to the checked-in one
+// usage: test-rasterizer <golden.ppm> <output.ppm> (copy the output over the
+// golden image when the rendering changes on purpose)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rasterizer.h"
+
+#define IMAGE_WIDTH                     96
+#define IMAGE_HEIGHT                    64
+
+#define MODE_TEXTURED                   0x01
+#define MODE_COPY                       0x02
+#define MODE_UNPACKED                   0x04
+
+static uint8_t queue[512];
+static unsigned queue_length;
+static uint16_t texture[4096];
+
+static void put(uint8_t byte) {
+    queue[queue_length++] = byte;
+}
+
+static void put_rect(unsigned x1, unsigned y1, unsigned x2, unsigned y2) {
+    put(y1);
+    put(x1);
+    put(y2);
+    put(x2);
+    put(((y1 >> 8) & 3) | (((x1 >> 8) & 3) << 2) | (((y2 >> 8) & 3) << 4) | (((x2 >> 8) & 3) << 6));
+}
+
+static void put_base(uint32_t base) {
+    put(base);
+    put(base >> 8);
+    put((base >> 16) & 0x0f);
+}
+
+// color is 0xARGB
+static void rect_color(unsigned x1, unsigned y1, unsigned x2, unsigned y2, uint16_t color) {
+    put(0x00);
+    put_rect(x1, y1, x2, y2);
+    put(0);
+    put(((color >> 4) & 0x0f) << 4 | ((color >> 8) & 0x0f));
+    put((color >> 12) << 4 | (color & 0x0f));
+}
+
+static void rect_texture(unsigned x1, unsigned y1, unsigned x2, unsigned y2, uint8_t mode,
+                         unsigned stripe, uint32_t base, uint16_t color) {
+    put(0x00);
+    put_rect(x1, y1, x2, y2);
+    put(mode | ((stripe >> 8) << 6));
+    put(stripe);
+    put_base(base);
+    if (!(mode & MODE_UNPACKED)) {
+        put(((color >> 4) & 0x0f) << 4 | ((color >> 8) & 0x0f));
+        put(color & 0x0f);
+    }
+}
+
+static void relative(int dx, int dy, unsigned width, unsigned height) {
+    put((uint8_t) dx);
+    put((uint8_t) dy);
+    put(width - 1);
+    put(height - 1);
+}
+
+static void rect_same(int dx, int dy, unsigned width, unsigned height) {
+    put(0x01);
+    relative(dx, dy, width, height);
+}
+
+static void glyph(int dx, int dy, unsigned width, unsigned height, uint32_t base) {
+    relative(dx, dy, width, height);
+    put_base(base);
+}
+
+static void build_queue() {
+    // opaque background & alpha-mixed rectangles
+    rect_color(0, 0, 95, 63, 0xf123);
+    rect_color(4, 4, 40, 30, 0xfc84);
+    rect_color(20, 10, 70, 50, 0x84af);
+    rect_same(10, 10, 30, 20);
+    rect_same(-25, 20, 12, 8);
+
+    // packed alpha texture, unpacked texture & texture copy
+    rect_texture(50, 2, 81, 17, MODE_TEXTURED, 32, 0x100, 0x0fe8);
+    rect_texture(60, 40, 75, 55, MODE_TEXTURED | MODE_UNPACKED, 16, 0x800, 0);
+    rect_texture(78, 40, 93, 47, MODE_TEXTURED | MODE_COPY, 300, 0x2000, 0x0777);
+
+    // single glyph & glyph batch (texture & color of the previous command)
+    rect_texture(4, 44, 11, 55, MODE_TEXTURED, 8, 0x400, 0x0ff0);
+    put(0x02);
+    glyph(10, 0, 8, 12, 0x460);
+    put(0x03);
+    put(2);
+    glyph(10, 1, 8, 12, 0x4c0);
+    glyph(10, -1, 6, 10, 0x520);
+    glyph(8, 2, 4, 6, 0x580);
+
+    // column counter wrapping at 10 bits
+    rect_color(1016, 58, 5, 61, 0xf0f0);
+}
+
+static uint8_t *read_file(const char *name, long *length) {
+    FILE *file = fopen(name, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*length);
+    if (data && fread(data, 1, *length, file) != (size_t) *length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("Usage: %s <golden.ppm> <output.ppm>\n", argv[0]);
+        return 2;
+    }
+
+    unsigned i;
+    for (i = 0; i < sizeof(texture) / sizeof(texture[0]); i++)
+        texture[i] = (uint16_t) (i * 0x9e37 + (i >> 3) * 0x1111);
+    rasterizer_init();
+    rasterizer_set_texture_memory(texture, sizeof(texture) / sizeof(texture[0]));
+
+    build_queue();
+    if (!rasterizer_execute(queue, queue_length)) {
+        printf("Queue rejected\n");
+        return 1;
+    }
+    // truncated command
+    if (rasterizer_execute(queue, 5)) {
+        printf("Truncated queue accepted\n");
+        return 1;
+    }
+    if (!rasterizer_dump(argv[2], IMAGE_WIDTH, IMAGE_HEIGHT)) {
+        printf("Image %s not written\n", argv[2]);
+        return 1;
+    }
+
+    long golden_length, output_length;
+    uint8_t *golden = read_file(argv[1], &golden_length);
+    uint8_t *output = read_file(argv[2], &output_length);
+    if (!golden || !output) {
+        printf("Image %s not read\n", golden ? argv[2] : argv[1]);
+        return 1;
+    }
+    if (golden_length != output_length || memcmp(golden, output, output_length)) {
+        printf("%s differs from %s\n", argv[2], argv[1]);
+        return 1;
+    }
+
+    tRasterizerStatistics statistics;
+    rasterizer_get_statistics(&statistics);
+    printf("%d commands, %d filled, %d mixed, %d textured pixels\n", statistics.commands,
+           statistics.filled_pixels, statistics.mixed_pixels, statistics.textured_pixels);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// drives the scene mutators & frames, the snapshot of the rendered tiles has to
+// match the tile state whenever a frame is finished
+#include <stdio.h>
+#include <stdlib.h>
+#include "scene-decoder.h"
+#include "spi-flash.h"
+#include "test-scene.h"
+#include "../src/renderer-display.c"
+
+#define QUEUE_SIZE                      256
+#define ROUNDS                          3000
+
+static uint8_t image[64 * 1024];
+static uint8_t queue[QUEUE_SIZE];
+static uint8_t scene_memory[64 * 1024] __attribute__((aligned(8)));
+
+static const char *const words[] = {"", "0", "12.5", "speed", "-42 km/h", "ABCDEFGHIJ", "  x  "};
+
+static void mutate() {
+    tRendererTileHandle tile = test_random(renderer_tiles_count);
+    switch (test_random(6)) {
+        case 0:
+            renderer_set_visibility(tile, test_random(2));
+            break;
+        case 1:
+            renderer_set_position(tile, test_random(900) - 50, test_random(560) - 40);
+            break;
+        case 2:
+            renderer_set_color(tile, test_random(renderer_colors_simple_count));
+            break;
+        case 3:
+            renderer_set_text(test_random(renderer_texts_count), words[test_random(sizeof(words) / sizeof(words[0]))]);
+            break;
+        case 4:
+            renderer_set_number(test_random(renderer_texts_count), (int32_t) test_random(200000) - 100000,
+                                RENDERER_NUMBER_DECIMALS(test_random(3)) | RENDERER_NUMBER_PAD(test_random(4)));
+            break;
+        default:
+            if (test_random(20) == 0)
+                renderer_show_screen(test_random(renderer_screen_count));
+            break;
+    }
+}
+
+// returns the frame count
+static unsigned render(bool mutate_while_pending) {
+    unsigned frames = 0;
+    uint16_t length;
+    do {
+        renderer_update_display(queue, QUEUE_SIZE, &length);
+        if (length > QUEUE_SIZE) {
+            printf("Queue overflow %d\n", length);
+            exit(1);
+        }
+        frames++;
+        if (mutate_while_pending && renderer_frame_pending() && test_random(4) == 0)
+            mutate();
+    } while (renderer_frame_pending() || renderer_tiles_dirty);
+    return frames;
+}
+
+static bool snapshot_matches(unsigned round) {
+    unsigned i, words_count = RENDERER_BITMAP_WORDS(renderer_tiles_count);
+    for (i = 0; i < renderer_tiles_count; i++) {
+        if (memcmp(buffer.rects + i, renderer_tile_rects + i, sizeof(tRendererRect))
+            || memcmp(buffer.appearance + i, renderer_tile_appearance + i, sizeof(tRendererAppearance))) {
+            printf("Round %d: tile %d differs from the snapshot\n", round, i);
+            return false;
+        }
+    }
+    for (i = 0; i < words_count; i++) {
+        if (buffer.shown[i] != shown_tiles(i)) {
+            printf("Round %d: shown tiles %d-%d differ (0x%08x, snapshot 0x%08x)\n", round, i * 32, i * 32 + 31,
+                   shown_tiles(i), buffer.shown[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    const tTestScene scene = {400, 2, 12, 1};
+    uint32_t length = test_scene_stream(&scene, image, sizeof(image));
+    test_flash = image;
+    test_flash_length = length;
+    scene_decoder_set_memory(scene_memory, sizeof(scene_memory));
+    if (!length || !scene_decoder_decode(true) || scene_decoder_use_default()) {
+        printf("Scene not decoded\n");
+        return 1;
+    }
+
+    renderer_init();
+    renderer_show_screen(0);
+    render(false);
+    if (!snapshot_matches(0))
+        return 1;
+
+    unsigned round, frames = 0;
+    for (round = 1; round <= ROUNDS; round++) {
+        unsigned i, count = test_random(8);
+        for (i = 0; i < count; i++)
+            mutate();
+        test_time += 10;
+        frames += render(round & 1);
+        if (!snapshot_matches(round))
+            return 1;
+    }
+
+    tRendererStatistics statistics;
+    renderer_get_statistics(&statistics);
+    printf("%d rounds, %d queues, %d frames, %d areas\n", ROUNDS, frames, statistics.frames,
+           statistics.rendered_areas);
+    return 0;
+}
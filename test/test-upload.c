@@ -0,0 +1,237 @@
+// RLE round trip: bundles packed by tools/rle-pack are unpacked by the upload
+// (from the flash stand-in & from the memory) with runs & literals split between
+// the read chunks and the uploaded pages, skipped pages are left untouched and
+// truncated bundles are not reported complete
+// chained DMA: raw bundles go from the flash stand-in to the SPI stand-in through
+// the host backend only (the CPU upload routine is not called), also after a
+// chain cancelled in flight
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "renderer-definition.h"
+#include "data-upload.h"
+#include "spi-flash.h"
+#include "spi-vc.h"
+#include "upload-chain.h"
+#include "test-scene.h"
+#include "../tools/rle-pack/rle-pack.h"
+
+#define BUNDLE_SIZE                     (40 * 1024 + 123)
+#define PAGES                           ((BUNDLE_SIZE + RENDERER_BUNDLE_PAGE_SIZE - 1) / RENDERER_BUNDLE_PAGE_SIZE)
+#define UNTOUCHED                       0xa5
+
+static uint8_t bundle[BUNDLE_SIZE];
+static uint8_t packed[RLE_PACK_BOUND(BUNDLE_SIZE)];
+static uint8_t target[2 * BUNDLE_SIZE];
+static uint32_t packed_length;
+static unsigned cpu_uploads;
+static unsigned failures;
+
+#define CHECK(condition, ...)           { if (!(condition)) { printf(__VA_ARGS__); printf("\n"); failures++; } }
+
+static void store(const uint8_t *data, uint32_t offset, uint32_t length) {
+    if (offset + length > sizeof(target)) {
+        printf("Upload outside of the target (%d bytes at %d)\n", length, offset);
+        failures++;
+        return;
+    }
+    memcpy(target + offset, data, length);
+}
+
+static void upload(uint8_t *data, uint32_t offset, uint32_t length) {
+    cpu_uploads++;
+    store(data, offset, length);
+}
+
+static bool upload_finished() {
+    return true;
+}
+
+// same prefix as the video core uploads
+static uint8_t upload_prefix(uint32_t offset, uint8_t *prefix) {
+    prefix[0] = 0x02;
+    prefix[1] = (offset >> 16) & 0xff;
+    prefix[2] = (offset >> 8) & 0xff;
+    prefix[3] = (offset >> 0) & 0xff;
+    return 4;
+}
+
+static void vc_sink(const uint8_t *prefix, uint32_t prefix_length, const uint8_t *data, uint32_t length) {
+    if (prefix_length != 4 || prefix[0] != 0x02) {
+        printf("Unexpected prefix (%d bytes)\n", prefix_length);
+        failures++;
+        return;
+    }
+    store(data, prefix[1] << 16 | prefix[2] << 8 | prefix[3], length);
+}
+
+// uniform areas & noise, runs up to the longest encoded one
+static void build_bundle() {
+    uint32_t i = 0;
+    while (i < BUNDLE_SIZE) {
+        uint32_t n = 1 + test_random(test_random(4) ? 300 : 2);
+        uint8_t value = test_random(256);
+        bool run = test_random(2);
+        while (n-- && i < BUNDLE_SIZE)
+            bundle[i++] = run ? value : test_random(256);
+    }
+}
+
+// runs & literals crossing the read chunks (packed offsets) & the pages (unpacked ones)
+static void count_splits(unsigned *chunk_splits, unsigned *page_splits) {
+    uint32_t in = 0, out = 0;
+    *chunk_splits = 0;
+    *page_splits = 0;
+    while (in < packed_length) {
+        uint8_t control = packed[in];
+        uint32_t used = (control < 0x80) ? control + 2 : 2;
+        uint32_t produced = (control < 0x80) ? control + 1 : control - 0x7e;
+        if (in / RENDERER_BUNDLE_PAGE_SIZE != (in + used - 1) / RENDERER_BUNDLE_PAGE_SIZE)
+            (*chunk_splits)++;
+        if (out / RENDERER_BUNDLE_PAGE_SIZE != (out + produced - 1) / RENDERER_BUNDLE_PAGE_SIZE)
+            (*page_splits)++;
+        in += used;
+        out += produced;
+    }
+}
+
+static const uint8_t *source_data;
+static uint32_t source_addr;
+static uint32_t target_addr;
+
+static void run(tUploadDataRequest *request, uint32_t source_length, const uint32_t *skip_pages) {
+    memset(target, UNTOUCHED, sizeof(target));
+    memset(request, 0, sizeof(*request));
+    request->uploadDataRoutine = upload;
+    request->updateFinishedRoutine = upload_finished;
+    request->source_data = source_data;
+    request->source_addr = source_addr;
+    request->length = BUNDLE_SIZE;
+    request->compression = RENDERER_COMPRESSION_RLE;
+    request->source_length = source_length;
+    request->skip_pages = skip_pages;
+    upload_data_start(request);
+    unsigned steps = 0;
+    while (!request->finished && steps++ < 100000)
+        upload_data_handle();
+}
+
+// DMA completions interleaved with the main loop
+static void run_chained(tUploadDataRequest *request, const uint32_t *skip_pages, unsigned steps) {
+    memset(target, UNTOUCHED, sizeof(target));
+    memset(request, 0, sizeof(*request));
+    request->uploadDataRoutine = upload;
+    request->updateFinishedRoutine = upload_finished;
+    request->uploadPrefixRoutine = upload_prefix;
+    request->source_addr = source_addr;
+    request->target_addr = target_addr;
+    request->length = BUNDLE_SIZE;
+    request->skip_pages = skip_pages;
+    upload_data_start(request);
+    cpu_uploads = 0;
+    while (!request->finished && steps--) {
+        upload_data_handle();
+        unsigned i = test_random(3);
+        while (i--)
+            upload_chain_host_transfer();
+    }
+}
+
+static void chained() {
+    // cancelled chain to the second half (stale descriptors would be sent there)
+    tUploadDataRequest request;
+    target_addr = BUNDLE_SIZE;
+    run_chained(&request, NULL, 2);
+    upload_data_cancel();
+    target_addr = 0;
+    run_chained(&request, NULL, 100000);
+    CHECK(request.finished && request.complete && request.progress == BUNDLE_SIZE,
+          "Chain: not complete after a cancelled one (%d bytes)", request.progress)
+    CHECK(!memcmp(target, bundle, BUNDLE_SIZE), "Chain: bundle differs")
+    unsigned i;
+    for (i = BUNDLE_SIZE; i < sizeof(target) && target[i] == UNTOUCHED; i++)
+        continue;
+    CHECK(i == sizeof(target), "Chain: cancelled descriptors sent")
+    CHECK(cpu_uploads == 0, "Chain: %d chunks uploaded by the CPU", cpu_uploads)
+
+    uint32_t skip[(PAGES + 31) / 32] = {0};
+    renderer_bit_set(skip, 0, true);
+    renderer_bit_set(skip, 4, true);
+    renderer_bit_set(skip, PAGES - 1, true);
+    run_chained(&request, skip, 100000);
+    unsigned page;
+    for (page = 0; page < PAGES; page++) {
+        uint32_t offset = page * RENDERER_BUNDLE_PAGE_SIZE;
+        bool untouched = target[offset] == UNTOUCHED;
+        bool same = target[offset] == bundle[offset];
+        CHECK(renderer_bit_get(skip, page) ? untouched : same, "Chain: page %d %s", page,
+              renderer_bit_get(skip, page) ? "overwritten" : "differs")
+    }
+    CHECK(request.finished && cpu_uploads == 0, "Chain: not finished with skipped pages")
+}
+
+static void round_trip(const char *name) {
+    tUploadDataRequest request;
+    run(&request, packed_length, NULL);
+    CHECK(request.finished && request.complete && request.progress == BUNDLE_SIZE,
+          "%s: not complete (%d bytes)", name, request.progress)
+    CHECK(!memcmp(target, bundle, BUNDLE_SIZE), "%s: unpacked bundle differs", name)
+
+    // every third page resident
+    uint32_t skip[(PAGES + 31) / 32] = {0};
+    unsigned page;
+    for (page = 0; page < PAGES; page += 3)
+        renderer_bit_set(skip, page, true);
+    run(&request, packed_length, skip);
+    CHECK(request.complete, "%s: not complete with skipped pages", name)
+    for (page = 0; page < PAGES; page++) {
+        uint32_t offset = page * RENDERER_BUNDLE_PAGE_SIZE;
+        uint32_t length = (offset + RENDERER_BUNDLE_PAGE_SIZE > BUNDLE_SIZE) ? BUNDLE_SIZE - offset
+                                                                             : RENDERER_BUNDLE_PAGE_SIZE;
+        bool skipped = renderer_bit_get(skip, page);
+        bool untouched = true;
+        uint32_t i;
+        for (i = 0; i < length; i++)
+            untouched = untouched && target[offset + i] == UNTOUCHED;
+        CHECK(skipped ? untouched : !memcmp(target + offset, bundle + offset, length),
+              "%s: page %d %s", name, page, skipped ? "overwritten" : "differs")
+    }
+
+    // truncated -> finished, but not complete
+    run(&request, packed_length / 2, NULL);
+    CHECK(request.finished && !request.complete, "%s: truncated bundle reported complete", name)
+}
+
+int main() {
+    test_random_seed(23);
+    build_bundle();
+    packed_length = rle_pack(bundle, BUNDLE_SIZE, packed);
+    unsigned chunk_splits, page_splits;
+    count_splits(&chunk_splits, &page_splits);
+    CHECK(chunk_splits && page_splits, "Nothing split (%d between chunks, %d between pages)", chunk_splits,
+          page_splits)
+
+    // flash source at an unaligned address, raw bundle behind it
+    static uint8_t flash[sizeof(packed) + BUNDLE_SIZE + 100];
+    memcpy(flash + 77, packed, packed_length);
+    memcpy(flash + 77 + packed_length, bundle, BUNDLE_SIZE);
+    test_flash = flash;
+    test_flash_length = 77 + packed_length + BUNDLE_SIZE;
+    test_vc_sink = vc_sink;
+    source_addr = 77;
+    upload_data_init();
+    round_trip("Flash");
+
+    source_addr = 77 + packed_length;
+    chained();
+
+    source_data = packed;
+    source_addr = 0;
+    round_trip("Memory");
+
+    if (failures)
+        return 1;
+    printf("%d bytes packed to %d (%d runs split between chunks, %d between pages)\n", BUNDLE_SIZE,
+           packed_length, chunk_splits, page_splits);
+    return 0;
+}
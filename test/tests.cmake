@@ -0,0 +1,148 @@
+# host tests (platform drivers replaced by the stand-ins of test/support)
+enable_testing()
+
+set(RENDERER_TEST_INCLUDES
+        ${CMAKE_CURRENT_LIST_DIR}/support
+        ${CMAKE_CURRENT_LIST_DIR}/../include
+        ${CMAKE_CURRENT_LIST_DIR}/../src
+        ${CMAKE_CURRENT_LIST_DIR}/../src/video-core
+        ${CMAKE_CURRENT_LIST_DIR}/../src/scene-decoder
+)
+
+set(RENDERER_TEST_SUPPORT
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-platform.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-scene.c
+)
+
+set(RENDERER_TEST_SCENE_SOURCES
+        ${CMAKE_CURRENT_LIST_DIR}/../src/scene-decoder/scene-decoder.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/scene-decoder/crc32.c
+        ${CMAKE_CURRENT_LIST_DIR}/../default-scene/code/dashboard-definition.c
+)
+
+# snapshot of the rendered tiles
+add_executable(test-snapshot
+        ${CMAKE_CURRENT_LIST_DIR}/test-snapshot.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-video-core.c
+        ${RENDERER_TEST_SCENE_SOURCES}
+        ${RENDERER_TEST_SUPPORT}
+)
+target_include_directories(test-snapshot PRIVATE ${RENDERER_TEST_INCLUDES})
+add_test(NAME snapshot COMMAND test-snapshot)
+
+# incremental decoding & fallback
+add_executable(test-decoder
+        ${CMAKE_CURRENT_LIST_DIR}/test-decoder.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-display.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-video-core.c
+        ${RENDERER_TEST_SCENE_SOURCES}
+        ${RENDERER_TEST_SUPPORT}
+)
+target_include_directories(test-decoder PRIVATE ${RENDERER_TEST_INCLUDES})
+add_test(NAME decoder COMMAND test-decoder)
+
+# rasterizer golden image
+add_executable(test-rasterizer
+        ${CMAKE_CURRENT_LIST_DIR}/test-rasterizer.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/opengl/rasterizer.c
+)
+target_include_directories(test-rasterizer PRIVATE ${CMAKE_CURRENT_LIST_DIR}/../src/opengl)
+add_test(NAME rasterizer COMMAND test-rasterizer
+        ${CMAKE_CURRENT_LIST_DIR}/golden/rasterizer.ppm ${CMAKE_CURRENT_BINARY_DIR}/rasterizer.ppm)
+
+# command encoder against the command processor model
+add_executable(test-commands
+        ${CMAKE_CURRENT_LIST_DIR}/test-commands.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/opengl/rasterizer.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-video-core.c
+        ${RENDERER_TEST_SCENE_SOURCES}
+        ${RENDERER_TEST_SUPPORT}
+)
+target_include_directories(test-commands PRIVATE ${RENDERER_TEST_INCLUDES} ${CMAKE_CURRENT_LIST_DIR}/../src/opengl)
+add_test(NAME commands COMMAND test-commands
+        ${CMAKE_CURRENT_BINARY_DIR}/command-queue.hex ${CMAKE_CURRENT_BINARY_DIR}/commands.hex)
+set_tests_properties(commands PROPERTIES FIXTURES_SETUP command-vectors)
+
+# command processor testbench fed by the vectors of test-commands (Icarus Verilog)
+find_program(IVERILOG iverilog)
+find_program(VVP vvp)
+if (IVERILOG AND VVP)
+    add_custom_command(
+            OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/command-processor-test.vvp
+            DEPENDS ${CMAKE_CURRENT_LIST_DIR}/../fpga/test/CommandProcessorTest.v
+            ${CMAKE_CURRENT_LIST_DIR}/../fpga/design/renderer/CommandProcessor.v
+            COMMAND ${IVERILOG}
+            ARGS -o ${CMAKE_CURRENT_BINARY_DIR}/command-processor-test.vvp
+            ${CMAKE_CURRENT_LIST_DIR}/../fpga/test/CommandProcessorTest.v
+            ${CMAKE_CURRENT_LIST_DIR}/../fpga/design/renderer/CommandProcessor.v
+    )
+    add_custom_target(command-processor-test ALL DEPENDS ${CMAKE_CURRENT_BINARY_DIR}/command-processor-test.vvp)
+    add_test(NAME command-processor COMMAND ${VVP} ${CMAKE_CURRENT_BINARY_DIR}/command-processor-test.vvp
+            +queue=${CMAKE_CURRENT_BINARY_DIR}/command-queue.hex
+            +commands=${CMAKE_CURRENT_BINARY_DIR}/commands.hex)
+    set_tests_properties(command-processor PROPERTIES
+            FIXTURES_REQUIRED command-vectors
+            PASS_REGULAR_EXPRESSION "PASSED")
+endif ()
+
+# scene decoding benchmark (10k+ tiles, smoke run as a test)
+add_executable(bench-decoder
+        ${CMAKE_CURRENT_LIST_DIR}/bench-decoder.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-display.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-video-core.c
+        ${RENDERER_TEST_SCENE_SOURCES}
+        ${RENDERER_TEST_SUPPORT}
+)
+target_include_directories(bench-decoder PRIVATE ${RENDERER_TEST_INCLUDES})
+target_compile_definitions(bench-decoder PRIVATE RENDERER_MAX_TILES=16384)
+target_compile_options(bench-decoder PRIVATE -O2)
+add_test(NAME bench-decoder COMMAND bench-decoder 2)
+
+# RLE round trip through the upload & chained DMA (host backend)
+add_executable(test-upload
+        ${CMAKE_CURRENT_LIST_DIR}/test-upload.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/video-core/data-upload.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/video-core/upload-chain-host.c
+        ${CMAKE_CURRENT_LIST_DIR}/../tools/rle-pack/rle-pack.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-display.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+        ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+        ${CMAKE_CURRENT_LIST_DIR}/support/test-video-core.c
+        ${RENDERER_TEST_SCENE_SOURCES}
+        ${RENDERER_TEST_SUPPORT}
+)
+target_include_directories(test-upload PRIVATE ${RENDERER_TEST_INCLUDES})
+target_compile_definitions(test-upload PRIVATE UPLOAD_CHAIN)
+add_test(NAME upload COMMAND test-upload)
+
+# rendering latency with the status polling & the ready line (simulated core)
+foreach (MODE poll irq)
+    add_executable(bench-ready-${MODE}
+            ${CMAKE_CURRENT_LIST_DIR}/bench-ready.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/video-core/video-core.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/video-core/data-upload.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-display.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-scene.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-index.c
+            ${CMAKE_CURRENT_LIST_DIR}/../src/renderer-damage.c
+            ${RENDERER_TEST_SCENE_SOURCES}
+            ${RENDERER_TEST_SUPPORT}
+    )
+    target_include_directories(bench-ready-${MODE} PRIVATE ${RENDERER_TEST_INCLUDES})
+endforeach ()
+target_compile_definitions(bench-ready-irq PRIVATE VC_READY_IRQ)
+add_test(NAME bench-ready-poll COMMAND bench-ready-poll)
+add_test(NAME bench-ready-irq COMMAND bench-ready-irq 1)
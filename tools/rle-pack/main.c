@@ -0,0 +1,37 @@
+// packs a texture bundle for the scene image (stored_length is the output size)
+// usage: rle-pack <bundle> <packed bundle>
+#include <stdio.h>
+#include <stdlib.h>
+#include "rle-pack.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("Usage: %s <bundle> <packed bundle>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        printf("%s not opened\n", argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *input = malloc(length ? length : 1);
+    uint8_t *output = malloc(RLE_PACK_BOUND(length) + 1);
+    if (!input || !output || fread(input, 1, length, file) != (size_t) length) {
+        printf("%s not read\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    uint32_t packed = rle_pack(input, length, output);
+    file = fopen(argv[2], "wb");
+    if (!file || fwrite(output, 1, packed, file) != packed || fclose(file)) {
+        printf("%s not written\n", argv[2]);
+        return 1;
+    }
+    printf("%ld bytes packed to %d\n", length, packed);
+    return 0;
+}
@@ -0,0 +1,43 @@
+// runs of 3+ bytes are repeated (up to 129), anything else is copied as literals
+// (up to 128, a 2-byte run does not interrupt them)
+#include "rle-pack.h"
+
+#define RUN_MIN                         3
+#define RUN_MAX                         129
+#define LITERAL_MAX                     128
+
+static uint32_t run_length(const uint8_t *input, uint32_t length) {
+    uint32_t n = 1;
+    while (n < length && n < RUN_MAX && input[n] == input[0])
+        n++;
+    return n;
+}
+
+uint32_t rle_pack(const uint8_t *input, uint32_t length, uint8_t *output) {
+    uint8_t *out = output;
+    uint32_t i = 0;
+    while (i < length) {
+        uint32_t n = run_length(input + i, length - i);
+        if (n >= RUN_MIN) {
+            *out++ = n + 0x7e;
+            *out++ = input[i];
+            i += n;
+            continue;
+        }
+
+        // literals up to the next run
+        uint32_t start = i;
+        while (i < length && i - start < LITERAL_MAX) {
+            n = run_length(input + i, length - i);
+            if (n >= RUN_MIN)
+                break;
+            if (n > LITERAL_MAX - (i - start))
+                n = LITERAL_MAX - (i - start);
+            i += n;
+        }
+        *out++ = i - start - 1;
+        for (n = start; n < i; n++)
+            *out++ = input[n];
+    }
+    return out - output;
+}
@@ -0,0 +1,14 @@
+// RLE packing of the texture bundles (RENDERER_COMPRESSION_RLE), unpacked by
+// data-upload while uploading
+#ifndef HEAD_UNIT_RLE_PACK_H
+#define HEAD_UNIT_RLE_PACK_H
+
+#include <stdint.h>
+
+// worst case (literals only)
+#define RLE_PACK_BOUND(length)          ((length) + ((length) + 127) / 128)
+
+// returns the packed length, the output holds RLE_PACK_BOUND(length) bytes
+uint32_t rle_pack(const uint8_t *input, uint32_t length, uint8_t *output);
+
+#endif //HEAD_UNIT_RLE_PACK_H
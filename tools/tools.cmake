@@ -0,0 +1,5 @@
+# host tools for building scene images
+add_executable(rle-pack
+        ${CMAKE_CURRENT_LIST_DIR}/rle-pack/main.c
+        ${CMAKE_CURRENT_LIST_DIR}/rle-pack/rle-pack.c
+)